@@ -0,0 +1,78 @@
+/*
+  BackupRam.c - Battery backed memory Implementation
+  Part of STM32F4_HAL
+
+  Copyright (c)	2021 Patrick F.
+
+  STM32F4_HAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  STM32F4_HAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with STM32F4_HAL.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "stm32f4xx_rcc.h"
+#include "stm32f4xx_pwr.h"
+#include "stm32f4xx_rtc.h"
+#include "BackupRam.h"
+
+
+void BackupRam_Init(void)
+{
+    // Allow write access to the backup domain
+    RCC_APB1PeriphClockCmd(RCC_APB1Periph_PWR, ENABLE);
+    PWR_BackupAccessCmd(ENABLE);
+
+#ifdef STM32F446xx
+    RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_BKPSRAM, ENABLE);
+
+    // Keep backup SRAM powered from VBAT
+    PWR_BackupRegulatorCmd(ENABLE);
+    while(PWR_GetFlagStatus(PWR_FLAG_BRR) == RESET);
+#endif
+}
+
+
+void BackupRam_Read(uint16_t addr, uint8_t *data, uint16_t size)
+{
+    for(; size > 0 && addr < BACKUP_RAM_SIZE; size--, addr++)
+    {
+#ifdef STM32F446xx
+        *(data++) = *(__IO uint8_t*)(BKPSRAM_BASE + addr);
+#else
+        uint32_t reg = RTC_ReadBackupRegister(addr / 4);
+
+        *(data++) = (uint8_t)(reg >> (8 * (addr % 4)));
+#endif
+    }
+}
+
+
+bool BackupRam_Write(uint16_t addr, const uint8_t *data, uint16_t size)
+{
+    if((uint32_t)addr + size > BACKUP_RAM_SIZE)
+    {
+        return false;
+    }
+
+    for(; size > 0; size--, addr++)
+    {
+#ifdef STM32F446xx
+        *(__IO uint8_t*)(BKPSRAM_BASE + addr) = *(data++);
+#else
+        // Backup registers are word wide
+        uint32_t reg = RTC_ReadBackupRegister(addr / 4);
+
+        reg &= ~(0xFFUL << (8 * (addr % 4)));
+        reg |= (uint32_t)*(data++) << (8 * (addr % 4));
+
+        RTC_WriteBackupRegister(addr / 4, reg);
+#endif
+    }
+
+    return true;
+}
@@ -0,0 +1,43 @@
+/*
+  BackupRam.h - Battery backed memory Header
+  Part of STM32F4_HAL
+
+  Copyright (c)	2021 Patrick F.
+
+  STM32F4_HAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  STM32F4_HAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  You should have received a copy of the GNU General Public License
+  along with STM32F4_HAL.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef BACKUPRAM_H
+#define BACKUPRAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+// The F446 has 4 KB of backup SRAM. The F411 only provides the 20 RTC backup registers.
+// Both keep their content over a reset, and over a power cycle if VBAT is supplied by a battery.
+#define BACKUP_REG_SIZE             80      // RTC backup registers, available on every target
+
+#ifdef STM32F446xx
+    #define BACKUP_RAM_SIZE         4096
+#else
+    #define BACKUP_RAM_SIZE         BACKUP_REG_SIZE
+#endif
+
+
+void BackupRam_Init(void);
+
+void BackupRam_Read(uint16_t addr, uint8_t *data, uint16_t size);
+// Returns false and writes nothing, if the data doesn't fit into the backup memory.
+bool BackupRam_Write(uint16_t addr, const uint8_t *data, uint16_t size);
+
+
+#endif /* BACKUPRAM_H */
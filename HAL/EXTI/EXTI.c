@@ -1,56 +1,140 @@
 #include "stm32f4xx_exti.h"
+#include "stm32f4xx_syscfg.h"
+#include "stm32f4xx_rcc.h"
+#include "misc.h"
 #include "EXTI.h"
+#include "TIM.h"
+#include "Config.h"
+
+
+// Lines currently masked for debouncing
+static volatile uint32_t debounce_lines = 0;
 
 
 /* Private function prototypes -----------------------------------------------*/
+static void Exti_EnableIRQ(uint8_t channel, uint8_t preemp_prio, uint8_t sub_prio);
 
 
 void Exti_Init0(uint8_t preemp_prio, uint8_t sub_prio)
 {
-	// Suppress compiler warning
-	(void)preemp_prio;
-	(void)sub_prio;
+	Exti_EnableIRQ(EXTI0_IRQn, preemp_prio, sub_prio);
 }
 
 
 void Exti_Init1(uint8_t preemp_prio, uint8_t sub_prio)
 {
-	(void)preemp_prio;
-	(void)sub_prio;
+	Exti_EnableIRQ(EXTI1_IRQn, preemp_prio, sub_prio);
 }
 
 
 void Exti_Init2(uint8_t preemp_prio, uint8_t sub_prio)
 {
-	(void)preemp_prio;
-	(void)sub_prio;
+	Exti_EnableIRQ(EXTI2_IRQn, preemp_prio, sub_prio);
 }
 
 
 void Exti_Init3(uint8_t preemp_prio, uint8_t sub_prio)
 {
-	(void)preemp_prio;
-	(void)sub_prio;
+	Exti_EnableIRQ(EXTI3_IRQn, preemp_prio, sub_prio);
 }
 
 
 void Exti_Init4(uint8_t preemp_prio, uint8_t sub_prio)
 {
-	(void)preemp_prio;
-	(void)sub_prio;
+	Exti_EnableIRQ(EXTI4_IRQn, preemp_prio, sub_prio);
 }
 
 
 // External interrupt for line 5 to 9
 void Exti_Init9_5(uint8_t preemp_prio, uint8_t sub_prio)
 {
-	(void)preemp_prio;
-	(void)sub_prio;
+	Exti_EnableIRQ(EXTI9_5_IRQn, preemp_prio, sub_prio);
 }
 
 
 void Exti_Init15_10(uint8_t preemp_prio, uint8_t sub_prio)
 {
-	(void)preemp_prio;
-	(void)sub_prio;
+	Exti_EnableIRQ(EXTI15_10_IRQn, preemp_prio, sub_prio);
+}
+
+
+// Connects a GPIO pin to its EXTI line. Interrupts on both edges.
+// NOTE: Called from thread context. The registers are shared with the debounce handling in the EXTI and TIM2
+// interrupts, so the read-modify-write updates are done with interrupts disabled.
+void Exti_ConfigLine(uint8_t port_source, uint8_t pin_source)
+{
+	uint32_t line = (1UL << pin_source);
+
+	RCC_APB2PeriphClockCmd(RCC_APB2Periph_SYSCFG, ENABLE);
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	SYSCFG_EXTILineConfig(port_source, pin_source);
+
+	EXTI->EMR &= ~line;
+	EXTI->RTSR |= line;
+	EXTI->FTSR |= line;
+	EXTI->PR = line;
+	EXTI->IMR |= line;
+
+	__set_PRIMASK(primask);
+}
+
+
+void Exti_DisableLine(uint8_t pin_source)
+{
+	uint32_t line = (1UL << pin_source);
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	EXTI->IMR &= ~line;
+	EXTI->RTSR &= ~line;
+	EXTI->FTSR &= ~line;
+	EXTI->PR = line;
+
+	debounce_lines &= ~line;
+
+	__set_PRIMASK(primask);
+}
+
+
+// Clears the pending lines and masks them, until the debounce timer expires.
+// A new edge on another line restarts the timer.
+void Exti_Debounce(uint32_t lines)
+{
+	EXTI->PR = lines;
+	EXTI->IMR &= ~lines;
+
+	debounce_lines |= lines;
+
+	TIM2_StartOneShot(INPUT_DEBOUNCE_TIME);
+}
+
+
+// Called when the debounce timer expired. Unmasks and returns the debounced lines.
+uint32_t Exti_DebounceDone(void)
+{
+	uint32_t lines = debounce_lines;
+
+	debounce_lines = 0;
+
+	// Ignore bouncing while masked
+	EXTI->PR = lines;
+	EXTI->IMR |= lines;
+
+	return lines;
+}
+
+
+static void Exti_EnableIRQ(uint8_t channel, uint8_t preemp_prio, uint8_t sub_prio)
+{
+	NVIC_InitTypeDef NVIC_InitStructure;
+
+	NVIC_InitStructure.NVIC_IRQChannel = channel;
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = preemp_prio;
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = sub_prio;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStructure);
 }
@@ -24,6 +24,17 @@ void Exti_Init9_5(uint8_t preemp_prio, uint8_t sub_prio);
 
 void Exti_Init15_10(uint8_t preemp_prio, uint8_t sub_prio);
 
+// Connects pin to its EXTI line. port_source: EXTI_PortSourceGPIOx, pin_source: EXTI_PinSourcex
+void Exti_ConfigLine(uint8_t port_source, uint8_t pin_source);
+
+void Exti_DisableLine(uint8_t pin_source);
+
+// Masks lines for INPUT_DEBOUNCE_TIME
+void Exti_Debounce(uint32_t lines);
+
+// Called by debounce timer interrupt. Returns lines, that were debounced.
+uint32_t Exti_DebounceDone(void);
+
 
 #ifdef __cplusplus
 }
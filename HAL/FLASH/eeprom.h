@@ -26,7 +26,7 @@
 #if (USE_EXT_EEPROM)
     #define EEPROM_SIZE         1
 #else
-    #define EEPROM_SIZE			1024
+    #define EEPROM_SIZE			4096
 #endif
 
 /* Device voltage range supposed to be [2.7V to 3.6V], the operation will be done by word  */
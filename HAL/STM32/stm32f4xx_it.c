@@ -37,14 +37,15 @@
 #include "Config.h"
 #include "MotionControl.h"
 #include "Encoder.h"
+#include "SpindleControl.h"
+#include "EXTI.h"
+#include "Probe.h"
+#include "ProbeScan.h"
 #include "Platform.h"
 #include "TIM.h"
 #include <stdbool.h>
 
 
-#define RPM_FILTER_NUM      3
-
-
 /** @addtogroup Template_Project
   * @{
   */
@@ -56,18 +57,9 @@
 /* Private function prototypes -----------------------------------------------*/
 /* Private functions ---------------------------------------------------------*/
 
-extern void Limit_PinChangeISR(void);
-extern void System_PinChangeISR(void);
-
-
 // Counter for milliseconds
 static volatile uint32_t gMillis = 0;
 
-uint32_t spindle_rpm = 0;
-static uint16_t tim4_cnt_prev = 0;
-static uint32_t rpm_arr[RPM_FILTER_NUM] = {0};
-static uint8_t rpm_idx = 0;
-
 
 /******************************************************************************/
 /*            Cortex-M4 Processor Exceptions Handlers                         */
@@ -233,6 +225,9 @@ void DebugMon_Handler(void)
   */
 void PendSV_Handler(void)
 {
+#ifdef STEPPER_PREP_IN_ISR
+    Stepper_PrepareBufferISR();
+#endif
 }
 
 
@@ -244,23 +239,19 @@ void PendSV_Handler(void)
 void SysTick_Handler(void)
 {
 	/*
-	 * Because of the board layout, we cant attach all pins to interrupts.
-	 * Therefore we just poll them in this 1ms task, which is hopefully fast
-	 * enough for critical events. Debouncing pins is also implemented here.
+	 * Because of the board layout, not all limit pins have their own EXTI line.
+	 * These are polled here.
 	 */
-	uint8_t limits = Limits_GetState(false);
-    if (limits && (sys.system_flags & BITFLAG_ENABLE_LIMITS))
-    {
-        // X-Y-Z Limit
-        Limit_PinChangeISR();
-    }
+    Limits_PollISR();
 
-    uint8_t controls = System_GetControlState(false);
-    if (controls && (sys.system_flags & BITFLAG_ENABLE_SYSTEM_INPUT))
+    if(Probe_LatchEnabled())
     {
-        System_PinChangeISR();
+        // Reset pin lost its EXTI line to the probe
+        System_ControlEdgeISR();
     }
 
+    Scan_SampleISR();
+
     gMillis++;
 
     if(gMillis%16 == 0)
@@ -269,38 +260,16 @@ void SysTick_Handler(void)
         MC_UpdateSyncMove();
     }
 
-    if(gMillis%32 == 0)
-    {
-        uint16_t cnt = (uint16_t)Encoder_GetValue();
-        uint32_t cnt_diff = 0;
-
-        // Calculate ticks since last event
-        if(cnt < tim4_cnt_prev)
-        {
-            // Ovf
-            cnt_diff = (0xFFFF - tim4_cnt_prev) + cnt;
-        }
-        else
-        {
-            cnt_diff = cnt - tim4_cnt_prev;
-        }
-
-        // Calculate RPM and smooth it
-        if (settings.enc_ppr > 0)
-        {
-            float rpm = ((cnt_diff * 31.25) / settings.enc_ppr) * 60.0;
-            rpm_arr[rpm_idx++] = (uint32_t)rpm;
-            if (rpm_idx > (RPM_FILTER_NUM - 1))
-            {
-                rpm_idx = 0;
-            }
-        }
-
-        // Assign smoothed RPM
-        spindle_rpm = (rpm_arr[0] + rpm_arr[1] + rpm_arr[2]) / RPM_FILTER_NUM;
+    // Spindle speed
+    Encoder_UpdateSpeed();
 
-        tim4_cnt_prev = cnt;
+#ifdef ENABLE_SPINDLE_PID
+    if(gMillis%SPINDLE_PID_PERIOD == 0)
+    {
+        // Spindle speed regulation
+        Spindle_UpdatePID();
     }
+#endif
 }
 
 
@@ -350,10 +319,12 @@ void TIM4_IRQHandler(void)
 {
     if(TIM_GetITStatus(TIM4, TIM_IT_Update) != RESET)
     {
-		// OVF
-		TIM_ClearITPendingBit(TIM4, TIM_IT_Update);
-
+		// OVF. Count is updated before the flag is cleared, without a stepper interrupt in between.
+		// Encoder_GetValue() adds the revolution itself, while the flag is pending.
+		__disable_irq();
 		Encoder_OvfISR();
+		TIM_ClearITPendingBit(TIM4, TIM_IT_Update);
+		__enable_irq();
 
         // Spindle at zero position
         /*if(sys.sync_move && sys.state == STATE_HOLD)
@@ -361,6 +332,13 @@ void TIM4_IRQHandler(void)
             MC_LineSyncStart();
         }*/
 	}
+    if(TIM_GetITStatus(TIM4, TIM_IT_CC1) != RESET)
+    {
+        // Encoder edge
+        TIM_ClearITPendingBit(TIM4, TIM_IT_CC1);
+
+        Encoder_CaptureISR();
+    }
 }
 
 
@@ -371,6 +349,79 @@ void TIM4_IRQHandler(void)
   */
 void EXTI9_5_IRQHandler(void)
 {
+    // Limit pins
+    uint32_t lines = EXTI->PR & (EXTI_Line5 | EXTI_Line6 | EXTI_Line7 | EXTI_Line8 | EXTI_Line9);
+
+    Exti_Debounce(lines);
+    Limits_EdgeISR();
+}
+
+
+/**
+  * @brief  These functions handle the control pin interrupts (reset, feed hold, safety door, cycle start).
+  * @param  None
+  * @retval None
+  */
+void EXTI0_IRQHandler(void)
+{
+    if(Probe_LatchEnabled())
+    {
+        // Probe pin during probing cycle. Not debounced, first trigger is latched.
+        EXTI_ClearITPendingBit(EXTI_Line0);
+        Probe_EdgeISR();
+    }
+    else
+    {
+        Exti_Debounce(EXTI_Line0);
+        System_ControlEdgeISR();
+    }
+}
+
+
+void EXTI1_IRQHandler(void)
+{
+    Exti_Debounce(EXTI_Line1);
+    System_ControlEdgeISR();
+}
+
+
+void EXTI2_IRQHandler(void)
+{
+    Exti_Debounce(EXTI_Line2);
+    System_ControlEdgeISR();
+}
+
+
+void EXTI4_IRQHandler(void)
+{
+    Exti_Debounce(EXTI_Line4);
+    System_ControlEdgeISR();
+}
+
+
+/**
+  * @brief  This function handles TIM2 global interrupt request.
+  *         Input debounce time expired.
+  * @param  None
+  * @retval None
+  */
+void TIM2_IRQHandler(void)
+{
+    if(TIM_GetITStatus(TIM2, TIM_IT_Update) != RESET)
+    {
+        TIM_ClearITPendingBit(TIM2, TIM_IT_Update);
+
+        uint32_t lines = Exti_DebounceDone();
+
+        if(lines & (EXTI_Line5 | EXTI_Line6 | EXTI_Line7 | EXTI_Line8 | EXTI_Line9))
+        {
+            Limits_DebounceISR();
+        }
+        if(lines & (EXTI_Line0 | EXTI_Line1 | EXTI_Line2 | EXTI_Line4))
+        {
+            System_ControlEdgeISR();
+        }
+    }
 }
 
 
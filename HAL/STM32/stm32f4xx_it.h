@@ -53,6 +53,12 @@ void PendSV_Handler(void);
 void SysTick_Handler(void);
 
 void TIM1_BRK_TIM9_IRQHandler(void);
+void TIM2_IRQHandler(void);
+void EXTI0_IRQHandler(void);
+void EXTI1_IRQHandler(void);
+void EXTI2_IRQHandler(void);
+void EXTI4_IRQHandler(void);
+void EXTI9_5_IRQHandler(void);
 void USART1_IRQHandler(void);
 void USART2_IRQHandler(void);
 void USART6_IRQHandler(void);
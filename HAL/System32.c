@@ -27,6 +27,11 @@ void SysTick_Init(void)
     SysTick_Config(RCC_Clocks.HCLK_Frequency / 1000);
 
     NVIC_SetPriority(SysTick_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), 5, 5));
+
+    // Enable cycle counter. Used for run time measurement and encoder edge time stamps.
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT_CYCCNT_REG = 0;
+    DWT_CTRL_REG |= DWT_CTRL_CYCCNTENA;
 }
 
 
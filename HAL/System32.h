@@ -22,6 +22,12 @@
 #include "stm32f4xx_it.h"
 
 
+// DWT cycle counter registers. Not defined by the bundled CMSIS core header.
+#define DWT_CTRL_REG            (*(volatile uint32_t*)0xE0001000)
+#define DWT_CYCCNT_REG          (*(volatile uint32_t*)0xE0001004)
+#define DWT_CTRL_CYCCNTENA      (1UL << 0)
+
+
 #ifdef __cplusplus
 extern "C" {
 #endif
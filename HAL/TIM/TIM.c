@@ -22,10 +22,11 @@
 
 /**
  * Timer 1
- * Outputs 10 KHz on D11
+ * Base clock: F_TIMER_SPINDLE
+ * Outputs F_TIMER_SPINDLE/period on D11
  * Used for Variable Spindle PWM
  **/
-void TIM1_Init(void)
+void TIM1_Init(uint16_t period)
 {
 	TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
 	TIM_OCInitTypeDef TIM_OCInitStructure;
@@ -34,11 +35,11 @@ void TIM1_Init(void)
 	RCC_APB2PeriphClockCmd(RCC_APB2Periph_TIM1, ENABLE);
 
 	/* Time base configuration */
-	TIM_TimeBaseStructure.TIM_Period = TIM1_INIT-1;		// ~10 KHz
+	TIM_TimeBaseStructure.TIM_Period = period-1;
 #ifdef STM32F411xE
-	TIM_TimeBaseStructure.TIM_Prescaler = 48-1;		// 2 MHz
+	TIM_TimeBaseStructure.TIM_Prescaler = 1-1;		// 96 MHz
 #elif STM32F446xx
-    TIM_TimeBaseStructure.TIM_Prescaler = 84-1;		// 2 MHz
+    TIM_TimeBaseStructure.TIM_Prescaler = 2-1;		// 84 MHz
 #else
     #warning No Timer clock set for stepper spindle pwm
 #endif
@@ -67,11 +68,49 @@ void TIM1_Init(void)
 
 /**
  * Timer 2
- * Used for Encoder
+ * Base clock: 1 MHz
+ * One-shot timer for input debouncing
  **/
 void TIM2_Init(void)
 {
+	NVIC_InitTypeDef NVIC_InitStructure;
+	TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+	RCC_ClocksTypeDef RCC_Clocks;
+
+	/* TIM2 clock enable */
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2, ENABLE);
+
+	// APB1 timers run at twice the APB1 clock
+	RCC_GetClocksFreq(&RCC_Clocks);
+
+	/* Time base configuration */
+	TIM_TimeBaseStructure.TIM_Period = 0xFFFF;
+	TIM_TimeBaseStructure.TIM_Prescaler = ((2 * RCC_Clocks.PCLK1_Frequency) / 1000000) - 1;
+	TIM_TimeBaseStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+	TIM_TimeBaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+	TIM_TimeBaseInit(TIM2, &TIM_TimeBaseStructure);
+
+	// Stop counter at update event
+	TIM_SelectOnePulseMode(TIM2, TIM_OPMode_Single);
+	TIM_ClearITPendingBit(TIM2, TIM_IT_Update);
+
+	/* Enable the TIM2 global Interrupt */
+	NVIC_InitStructure.NVIC_IRQChannel = TIM2_IRQn;
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 2;
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStructure);
 
+	TIM_ITConfig(TIM2, TIM_IT_Update, ENABLE);
+}
+
+
+// Starts or restarts the one-shot timer. Update interrupt fires after 'us' microseconds.
+void TIM2_StartOneShot(uint32_t us)
+{
+	TIM2->ARR = us;
+	TIM2->CNT = 0;
+	TIM2->CR1 |= TIM_CR1_CEN;
 }
 
 
@@ -189,6 +228,28 @@ inline uint16_t TIM4_CNT(void)
 }
 
 
+// Encoder direction. Set, when the spindle turns backwards.
+bool TIM4_CountingDown(void)
+{
+    return (TIM4->CR1 & TIM_CR1_DIR) != 0;
+}
+
+
+// Counter wrapped, but the update interrupt wasn't serviced yet
+bool TIM4_OverflowPending(void)
+{
+    return (TIM4->SR & TIM_SR_UIF) != 0;
+}
+
+
+// Interrupt on every captured encoder edge. Used for speed measurement at low speed.
+void TIM4_CaptureIT(bool enable)
+{
+    TIM_ClearITPendingBit(TIM4, TIM_IT_CC1);
+    TIM_ITConfig(TIM4, TIM_IT_CC1, enable ? ENABLE : DISABLE);
+}
+
+
 /**
  * Timer 9
  * Base clock: 24 MHz
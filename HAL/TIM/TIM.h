@@ -18,8 +18,16 @@
 #ifndef TIM_H_INCLUDED
 #define TIM_H_INCLUDED
 
+#include <stdint.h>
+#include <stdbool.h>
 
-#define TIM1_INIT       200
+
+// Spindle PWM timer clock
+#ifdef STM32F411xE
+#define F_TIMER_SPINDLE     96000000UL
+#else
+#define F_TIMER_SPINDLE     84000000UL
+#endif
 
 
 #ifdef __cplusplus
@@ -27,13 +35,18 @@ extern "C" {
 #endif
 
 
-void TIM1_Init(void);
+void TIM1_Init(uint16_t period);
 void TIM2_Init(void);
 void TIM3_Init(void);
 void TIM4_Init(uint16_t autoreload);
 void TIM9_Init(void);
 
 uint16_t TIM4_CNT(void);
+bool TIM4_CountingDown(void);
+bool TIM4_OverflowPending(void);
+void TIM4_CaptureIT(bool enable);
+
+void TIM2_StartOneShot(uint32_t us);
 
 
 #ifdef __cplusplus
@@ -112,22 +112,25 @@ void Usart_Init(USART_TypeDef *usart, uint32_t baud)
 	} else if(usart == USART6) {
 		/* Enable GPIO clock */
 		RCC_APB2PeriphClockCmd(RCC_APB2Periph_USART6, ENABLE);
-		RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_GPIOC, ENABLE);
+		RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_GPIOA, ENABLE);
 
-		GPIO_PinAFConfig(GPIOC, GPIO_PinSource6, GPIO_AF_USART6);
-		GPIO_PinAFConfig(GPIOC, GPIO_PinSource7, GPIO_AF_USART6);
+		// PA11/PA12, as PC7 is used by the X limit switch
+		GPIO_PinAFConfig(GPIOA, GPIO_PinSource11, GPIO_AF_USART6);
+		GPIO_PinAFConfig(GPIOA, GPIO_PinSource12, GPIO_AF_USART6);
 
 		/* Configure USART Tx as alternate function push-pull */
 		GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF;
-		GPIO_InitStructure.GPIO_Pin = GPIO_Pin_6;
+		GPIO_InitStructure.GPIO_Pin = GPIO_Pin_11;
 		GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
 		GPIO_InitStructure.GPIO_OType = GPIO_OType_PP;
-		GPIO_Init(GPIOC, &GPIO_InitStructure);
+		GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_NOPULL;
+		GPIO_Init(GPIOA, &GPIO_InitStructure);
 
-		/* Configure USART Rx as input floating */
+		/* Configure USART Rx as input with pull-up */
 		GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF;
-		GPIO_InitStructure.GPIO_Pin = GPIO_Pin_7;
-		GPIO_Init(GPIOC, &GPIO_InitStructure);
+		GPIO_InitStructure.GPIO_Pin = GPIO_Pin_12;
+		GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_UP;
+		GPIO_Init(GPIOA, &GPIO_InitStructure);
 
 		USART_InitStructure.USART_BaudRate = baud;
 		USART_InitStructure.USART_WordLength = USART_WordLength_8b;
@@ -17,16 +17,30 @@
   You should have received a copy of the GNU General Public License
   along with Grbl-Advanced.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <stdlib.h>
 #include "Encoder.h"
 #include "Config.h"
 #include "TIM.h"
+#include "System32.h"
 
 
 static uint32_t OvfCnt = 0;
-static uint32_t CntValue = 0;
+static volatile uint32_t CntValue = 0;
 
 static uint16_t PulsesPerRev = 360;
 static bool isZero = false;
+static bool isEnabled = false;
+
+// Speed measurement. At low speed, every encoder edge is time stamped (period method).
+// At high speed, counts are sampled every update (frequency method).
+static volatile uint32_t edge_pos = 0;
+static volatile uint32_t edge_time = 0;
+static volatile uint32_t edge_seq = 0;
+static bool capture_mode = false;
+static uint32_t ref_pos = 0;
+static uint32_t ref_time = 0;
+static float speed_raw = 0.0;       // rev/s
+static float speed_filtered = 0.0;  // rev/s
 
 
 void Encoder_Init(uint16_t ppr)
@@ -34,6 +48,10 @@ void Encoder_Init(uint16_t ppr)
     TIM4_Init(ppr);
     Encoder_Reset();
     PulsesPerRev = ppr;
+    isEnabled = (ppr > 0);
+
+    capture_mode = true;
+    TIM4_CaptureIT(true);
 }
 
 
@@ -42,6 +60,11 @@ void Encoder_Reset(void)
     OvfCnt = 0;
     CntValue = 0;
     isZero = false;
+
+    ref_pos = edge_pos = 0;
+    ref_time = edge_time = DWT_CYCCNT_REG;
+    speed_raw = 0.0;
+    speed_filtered = 0.0;
 }
 
 
@@ -51,9 +74,50 @@ void Encoder_SetPulsesPerRev(uint16_t ppr)
 }
 
 
+/* Extended encoder count. Combines the hardware counter with the counts of all completed revolutions.
+   Safe to call from any context: When called from an interrupt with higher priority than the overflow
+   interrupt (e.g. stepper ISR), a counter wrap that isn't accounted for yet is added here.
+   The value wraps at 2^32, so differences between two readings are valid as int32_t.
+*/
 uint32_t Encoder_GetValue(void)
 {
-    return CntValue + TIM4_CNT();
+    uint32_t base, cnt;
+    bool pending;
+
+    do
+    {
+        base = CntValue;
+        cnt = TIM4_CNT();
+        pending = TIM4_OverflowPending();
+
+        if(pending)
+        {
+            // Counter wrapped before or after reading it. Read again to get the value after the wrap.
+            cnt = TIM4_CNT();
+        }
+    } while(base != CntValue);   // Overflow interrupt ran meanwhile
+
+    // Account for the wrap the overflow interrupt didn't handle yet
+    if(pending)
+    {
+        if(TIM4_CountingDown())
+        {
+            base -= PulsesPerRev;
+        }
+        else
+        {
+            base += PulsesPerRev;
+        }
+    }
+
+    return base + cnt;
+}
+
+
+// Encoder value at the last index (overflow)
+uint32_t Encoder_GetIndexValue(void)
+{
+    return CntValue;
 }
 
 
@@ -77,6 +141,110 @@ bool Encoder_Zero(void)
 void Encoder_OvfISR(void)
 {
     OvfCnt++;
-    CntValue += PulsesPerRev;
+
+    // Underflow, when spindle is reversed (quadrature encoder only)
+    if(TIM4_CountingDown())
+    {
+        CntValue -= PulsesPerRev;
+    }
+    else
+    {
+        CntValue += PulsesPerRev;
+    }
     isZero = true;
 }
+
+
+void Encoder_CaptureISR(void)
+{
+    edge_pos = Encoder_GetValue();
+    edge_time = DWT_CYCCNT_REG;
+    edge_seq++;
+}
+
+
+void Encoder_UpdateSpeed(void)
+{
+    if(!isEnabled)
+    {
+        return;
+    }
+
+    uint32_t now = DWT_CYCCNT_REG;
+    uint32_t pos, time, seq;
+
+    if(capture_mode)
+    {
+        // Time of last edge. Retry, if an edge was captured meanwhile.
+        do
+        {
+            seq = edge_seq;
+            pos = edge_pos;
+            time = edge_time;
+        } while(seq != edge_seq);
+    }
+    else
+    {
+        pos = Encoder_GetValue();
+        time = now;
+    }
+
+    int32_t counts = (int32_t)(pos - ref_pos);
+    uint32_t cycles = time - ref_time;
+
+    if(counts != 0 && cycles > 0)
+    {
+        speed_raw = ((float)abs(counts) * SystemCoreClock) / ((float)cycles * PulsesPerRev);
+        ref_pos = pos;
+        ref_time = time;
+    }
+    else
+    {
+        // No new count. Speed can't be higher than one count in the time since the last one.
+        uint32_t idle = now - ref_time;
+
+        if(idle >= (SystemCoreClock / 1000) * ENCODER_SPEED_TIMEOUT)
+        {
+            // Spindle stopped
+            speed_raw = 0.0;
+            ref_pos = pos;
+            ref_time = now;
+        }
+        else if(idle > 0)
+        {
+            float max_speed = (float)SystemCoreClock / ((float)idle * PulsesPerRev);
+
+            if(speed_raw > max_speed)
+            {
+                speed_raw = max_speed;
+            }
+        }
+    }
+
+    // Switch measurement method with some hysteresis
+    float rate = speed_raw * PulsesPerRev;
+
+    if(capture_mode && rate > ENCODER_CAPTURE_MAX_RATE)
+    {
+        capture_mode = false;
+        TIM4_CaptureIT(false);
+        ref_pos = Encoder_GetValue();
+        ref_time = DWT_CYCCNT_REG;
+    }
+    else if(!capture_mode && rate < (ENCODER_CAPTURE_MAX_RATE * 3) / 4)
+    {
+        capture_mode = true;
+        edge_pos = ref_pos;
+        edge_time = ref_time;
+        TIM4_CaptureIT(true);
+    }
+
+    speed_filtered += ENCODER_SPEED_FILTER * (speed_raw - speed_filtered);
+}
+
+
+// Filtered speed (rev/s)
+float Encoder_GetSpeed(void)
+{
+    return speed_filtered;
+}
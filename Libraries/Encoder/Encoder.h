@@ -17,11 +17,18 @@ void Encoder_Reset(void);
 void Encoder_SetPulsesPerRev(uint16_t ppr);
 
 uint32_t Encoder_GetValue(void);
+uint32_t Encoder_GetIndexValue(void);
+
 void Encoder_SetValue(uint32_t val);
 
 bool Encoder_Zero(void);
 
 void Encoder_OvfISR(void);
+void Encoder_CaptureISR(void);
+
+// Speed measurement. Update every millisecond.
+void Encoder_UpdateSpeed(void);
+float Encoder_GetSpeed(void);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,257 @@
+/*
+  ModbusRTU.c - Modbus RTU master
+  Part of Grbl-Advanced
+
+  Copyright (c) 2021 Patrick F.
+
+  Grbl-Advanced is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl-Advanced is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl-Advanced.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include "ModbusRTU.h"
+#include "Usart.h"
+#include "FIFO_USART.h"
+
+
+#define MODBUS_MAX_FRAME            (5 + 2*MODBUS_MAX_REGISTERS)
+
+#define STATE_IDLE                  0
+#define STATE_WAIT                  1
+
+
+extern uint32_t millis(void);
+
+
+static uint8_t State = STATE_IDLE;
+static uint8_t RxBuffer[MODBUS_MAX_FRAME];
+static uint8_t RxLength = 0;
+static uint8_t ExpectedLength = 0;
+static uint8_t RequestSlave = 0;
+static uint8_t RequestFunction = 0;
+static uint8_t Exception = 0;
+
+static uint16_t Registers[MODBUS_MAX_REGISTERS] = {0};
+
+static uint32_t Baudrate = 9600;
+static uint32_t FrameGap = 5;       // ms
+static uint32_t LastActivity = 0;   // ms
+static uint32_t Deadline = 0;       // ms
+
+
+static uint16_t Modbus_CRC16(const uint8_t *data, uint8_t len)
+{
+    uint16_t crc = 0xFFFF;
+
+    while(len--)
+    {
+        crc ^= *data++;
+
+        for(uint8_t i = 0; i < 8; i++)
+        {
+            if(crc & 0x0001)
+            {
+                crc = (crc >> 1) ^ 0xA001;
+            }
+            else
+            {
+                crc >>= 1;
+            }
+        }
+    }
+
+    return crc;
+}
+
+
+// Appends CRC and queues the frame for transmission
+static void Modbus_Send(uint8_t *frame, uint8_t len)
+{
+    char c;
+
+    uint16_t crc = Modbus_CRC16(frame, len);
+    frame[len++] = crc & 0xFF;
+    frame[len++] = crc >> 8;
+
+    // Discard stale data
+    while(FifoUsart_Get(MODBUS_USART_NUM, USART_DIR_RX, &c) == 0);
+
+    RxLength = 0;
+    RequestSlave = frame[0];
+    RequestFunction = frame[1];
+    State = STATE_WAIT;
+
+    Usart_Write(MODBUS_USART, true, (char*)frame, len);
+
+    // Transmission time of 11 bits per character
+    Deadline = millis() + ((len * 11000UL) / Baudrate) + 1 + MODBUS_RESPONSE_TIMEOUT;
+}
+
+
+static uint8_t Modbus_Finish(uint8_t result)
+{
+    State = STATE_IDLE;
+    LastActivity = millis();
+
+    return result;
+}
+
+
+void Modbus_Init(uint32_t baud)
+{
+    Usart_Init(MODBUS_USART, baud);
+
+    Baudrate = baud;
+    // Silent interval of 3.5 characters, fixed 1.75 ms above 19200 baud. Plus one tick for the ms resolution.
+    FrameGap = (baud > 19200) ? 3 : ((38500UL / baud) + 2);
+
+    State = STATE_IDLE;
+    RxLength = 0;
+    LastActivity = millis();
+    memset(Registers, 0, sizeof(Registers));
+}
+
+
+bool Modbus_Ready(void)
+{
+    return (State == STATE_IDLE) && ((millis() - LastActivity) >= FrameGap);
+}
+
+
+bool Modbus_ReadRegisters(uint8_t slave, uint16_t addr, uint8_t count)
+{
+    uint8_t frame[8];
+
+    if(!Modbus_Ready() || count == 0 || count > MODBUS_MAX_REGISTERS)
+    {
+        return false;
+    }
+
+    frame[0] = slave;
+    frame[1] = MODBUS_FC_READ_HOLDING;
+    frame[2] = addr >> 8;
+    frame[3] = addr & 0xFF;
+    frame[4] = 0;
+    frame[5] = count;
+
+    // Slave, function, byte count, data, CRC
+    ExpectedLength = 5 + 2*count;
+    Modbus_Send(frame, 6);
+
+    return true;
+}
+
+
+bool Modbus_WriteRegister(uint8_t slave, uint16_t addr, uint16_t value)
+{
+    uint8_t frame[8];
+
+    if(!Modbus_Ready())
+    {
+        return false;
+    }
+
+    frame[0] = slave;
+    frame[1] = MODBUS_FC_WRITE_SINGLE;
+    frame[2] = addr >> 8;
+    frame[3] = addr & 0xFF;
+    frame[4] = value >> 8;
+    frame[5] = value & 0xFF;
+
+    // Echo of the request
+    ExpectedLength = 8;
+    Modbus_Send(frame, 6);
+
+    return true;
+}
+
+
+uint8_t Modbus_Poll(void)
+{
+    char c;
+
+    if(State == STATE_IDLE)
+    {
+        return MODBUS_IDLE;
+    }
+
+    while(RxLength < MODBUS_MAX_FRAME && FifoUsart_Get(MODBUS_USART_NUM, USART_DIR_RX, &c) == 0)
+    {
+        RxBuffer[RxLength++] = c;
+    }
+
+    // Exception response: Slave, function | 0x80, exception code, CRC
+    uint8_t length = ExpectedLength;
+    if(RxLength >= 2 && (RxBuffer[1] & 0x80))
+    {
+        length = 5;
+    }
+
+    if(RxLength >= length)
+    {
+        uint16_t crc = RxBuffer[length-2] | (RxBuffer[length-1] << 8);
+
+        if(crc != Modbus_CRC16(RxBuffer, length-2) || RxBuffer[0] != RequestSlave)
+        {
+            return Modbus_Finish(MODBUS_ERR_FRAME);
+        }
+        if(RxBuffer[1] == (RequestFunction | 0x80))
+        {
+            Exception = RxBuffer[2];
+
+            return Modbus_Finish(MODBUS_ERR_EXCEPTION);
+        }
+        if(RxBuffer[1] != RequestFunction)
+        {
+            return Modbus_Finish(MODBUS_ERR_FRAME);
+        }
+
+        if(RequestFunction == MODBUS_FC_READ_HOLDING)
+        {
+            if(RxBuffer[2] != (length - 5))
+            {
+                return Modbus_Finish(MODBUS_ERR_FRAME);
+            }
+
+            for(uint8_t i = 0; i < (RxBuffer[2] / 2); i++)
+            {
+                Registers[i] = (RxBuffer[3 + 2*i] << 8) | RxBuffer[4 + 2*i];
+            }
+        }
+
+        return Modbus_Finish(MODBUS_OK);
+    }
+
+    if((int32_t)(millis() - Deadline) >= 0)
+    {
+        return Modbus_Finish(MODBUS_ERR_TIMEOUT);
+    }
+
+    return MODBUS_BUSY;
+}
+
+
+uint16_t Modbus_GetRegister(uint8_t idx)
+{
+    if(idx >= MODBUS_MAX_REGISTERS)
+    {
+        return 0;
+    }
+
+    return Registers[idx];
+}
+
+
+uint8_t Modbus_GetException(void)
+{
+    return Exception;
+}
@@ -0,0 +1,77 @@
+/*
+  ModbusRTU.h - Modbus RTU master
+  Part of Grbl-Advanced
+
+  Copyright (c) 2021 Patrick F.
+
+  Grbl-Advanced is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl-Advanced is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl-Advanced.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef MODBUSRTU_H_INCLUDED
+#define MODBUSRTU_H_INCLUDED
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+// USART used for the Modbus line. Needs an RS485 transceiver with automatic direction control.
+#define MODBUS_USART                USART6
+#define MODBUS_USART_NUM            USART6_NUM
+
+#define MODBUS_RESPONSE_TIMEOUT     50      // ms, after the request was sent
+#define MODBUS_MAX_REGISTERS        8
+
+// Function codes
+#define MODBUS_FC_READ_HOLDING      0x03
+#define MODBUS_FC_WRITE_SINGLE      0x06
+
+// Result of Modbus_Poll
+#define MODBUS_IDLE                 0   // No request pending
+#define MODBUS_BUSY                 1   // Waiting for response
+#define MODBUS_OK                   2
+#define MODBUS_ERR_TIMEOUT          3
+#define MODBUS_ERR_FRAME            4   // CRC error or unexpected response
+#define MODBUS_ERR_EXCEPTION        5   // Slave returned an exception
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+void Modbus_Init(uint32_t baud);
+
+// True, if a new request can be sent (no request pending and frame gap elapsed)
+bool Modbus_Ready(void);
+
+// Start a request. Returns false, if the master is busy.
+bool Modbus_ReadRegisters(uint8_t slave, uint16_t addr, uint8_t count);
+bool Modbus_WriteRegister(uint8_t slave, uint16_t addr, uint16_t value);
+
+// Process received data. Returns the result once per request. Call periodically.
+uint8_t Modbus_Poll(void);
+
+// Register read by the last successful read request
+uint16_t Modbus_GetRegister(uint8_t idx);
+
+// Exception code of the last MODBUS_ERR_EXCEPTION
+uint8_t Modbus_GetException(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* MODBUSRTU_H_INCLUDED */
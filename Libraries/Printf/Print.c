@@ -96,6 +96,25 @@ void Printf_Flush(void)
 }
 
 
+// Sends raw bytes. Pending text is flushed first to keep the order.
+void Printf_Binary(const uint8_t *data, uint8_t len)
+{
+    Printf_Flush();
+
+#if (USE_ETH_IF)
+    Pdu_t pdu;
+
+    pdu.Data = (uint8_t*)data;
+    pdu.Length = len;
+
+    uint8_t ret = GrIP_Transmit(MSG_DATA_NO_RESPONSE, 0, &pdu);
+    (void)ret;
+#else
+    Usart_Write(STDOUT, false, (char*)data, len);
+#endif
+}
+
+
 // Convert float to string by immediately converting to a long integer, which contains
 // more digits than a float. Number of decimal places, which are tracked by a counter,
 // may be set by the user. The integer is then efficiently converted to a string.
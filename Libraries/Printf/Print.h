@@ -17,6 +17,7 @@ int8_t Getc(char *c);
 int Putc(const char c);
 
 void Printf_Flush(void);
+void Printf_Binary(const uint8_t *data, uint8_t len);
 
 
 #ifdef __cplusplus
@@ -148,6 +148,14 @@
 #define N_HOMING_LOCATE_CYCLE           1 // Integer (1-128)
 
 
+// Homes the axes of a cycle in parallel, each with its own velocity profile. Every axis (and each motor of a
+// dual axis gantry) runs seek, back-off, locate and pull-off on its own, using its max rate and acceleration.
+// A switch is latched by its limit interrupt and the axis decelerates to a stop instead of being cut off.
+// The switch must allow for the overtravel at seek rate (v^2/2a), e.g. 2.5mm at 3000mm/min and 500mm/s^2.
+// Comment to use the single planner block per cycle. NOT COMPATIBLE WITH COREXY.
+#define ENABLE_PARALLEL_HOMING // Default enabled. Comment to disable.
+
+
 // Enables single axis homing commands. $HX, $HY, and $HZ for X, Y, and Z-axis homing. The full homing
 // cycle is still invoked by the $H command. This is disabled by default. It's here only to address
 // users that need to switch between a two-axis and three-axis machine. This is actually very rare.
@@ -155,6 +163,15 @@
 // #define HOMING_SINGLE_AXIS_COMMANDS // Default disabled. Uncomment to enable.
 
 
+// Dual motor gantry. The A axis step/dir output drives a second Y motor, which mirrors all Y steps.
+// The Y1 limit switch belongs to the first, the Y2 limit switch to the second motor. When homing Y,
+// each motor stops at its own switch, which squares the gantry. Afterwards each motor moves by its
+// squaring offset ($43/$44) away from the switch. $3 bit 3 inverts the direction of the second motor.
+// NOTE: A axis words are rejected, while this is enabled. Not available in lathe mode.
+// Enabling or disabling it changes the settings layout, so the settings are reset to defaults.
+//#define ENABLE_DUAL_AXIS // Default disabled. Uncomment to enable.
+
+
 // After homing, Grbl will set by default the entire machine space into negative space, as is typical
 // for professional CNC machines, regardless of where the limit switches are located. Uncomment this
 // define to force Grbl to always set the machine origin at the homed location despite switch orientation.
@@ -203,6 +220,55 @@
 #define SAFETY_DOOR_COOLANT_DELAY       1.0 // Float (seconds)
 
 
+// Spindle-at-speed gate. With a spindle encoder (lathe mode and $15 > 0), M3/M4, S word changes and the
+// safety door restore wait until the measured RPM stays within SPINDLE_AT_SPEED_TOLERANCE of the
+// commanded RPM for SPINDLE_AT_SPEED_STABLE_TIME, instead of a fixed delay. If the spindle doesn't
+// reach its speed within SPINDLE_AT_SPEED_TIMEOUT, an alarm is raised.
+#define ENABLE_SPINDLE_AT_SPEED                 // Default enabled. Comment to disable.
+#define SPINDLE_AT_SPEED_TOLERANCE      5       // Percent
+#define SPINDLE_AT_SPEED_STABLE_TIME    200     // ms
+#define SPINDLE_AT_SPEED_TIMEOUT        10000   // ms
+
+// Spindle speed measurement. At low speed, the time between encoder edges is captured (period method).
+// Above ENCODER_CAPTURE_MAX_RATE counts/s, counts are sampled every millisecond instead (frequency method),
+// to limit the interrupt load. Without a new edge for ENCODER_SPEED_TIMEOUT, the spindle is considered
+// stopped. ENCODER_SPEED_FILTER is the weight of a new sample (1.0 = unfiltered).
+#define ENCODER_CAPTURE_MAX_RATE        20000   // counts/s
+#define ENCODER_SPEED_TIMEOUT           500     // ms
+#define ENCODER_SPEED_FILTER            0.2
+
+// Closed-loop spindle speed control. Needs lathe mode and a spindle encoder ($15). Every SPINDLE_PID_PERIOD
+// the PWM value of the spindle speed model is trimmed by a PID controller, so the measured RPM follows the
+// commanded RPM under load. The model value acts as feed-forward, the controller only corrects the error.
+// The trim is limited to SPINDLE_PID_MAX_TRIM of the PWM range. Gains are normalized to $30 and the PWM range.
+//#define ENABLE_SPINDLE_PID                    // Default disabled. Uncomment to enable.
+#define SPINDLE_PID_PERIOD              10      // ms
+#define SPINDLE_PID_KP                  0.5
+#define SPINDLE_PID_KI                  2.0
+#define SPINDLE_PID_KD                  0.0
+#define SPINDLE_PID_MAX_TRIM            0.25
+
+
+// Modbus RTU VFD spindle on USART6 (TX PA11, RX PA12). Needs an RS485 transceiver with automatic direction
+// control. Speed and direction are written to the VFD whenever they change, output frequency and current
+// are polled every VFD_POLL_INTERVAL. Runs alongside the PWM output. The register map below is for Delta
+// style drives (control word, frequency in 0.01 Hz). Adjust it to your VFD.
+//#define ENABLE_VFD_MODBUS                     // Default disabled. Uncomment to enable.
+#define VFD_MODBUS_BAUDRATE             9600
+#define VFD_MODBUS_ADDRESS              1
+#define VFD_POLL_INTERVAL               100     // ms
+#define VFD_MAX_ERRORS                  3       // Failed requests until VFD is considered offline
+#define VFD_REG_CONTROL                 0x2000
+#define VFD_REG_FREQ_SET                0x2001
+#define VFD_REG_FREQ_OUT                0x2103  // Followed by output current
+#define VFD_CMD_STOP                    0x0001
+#define VFD_CMD_RUN_CW                  0x0012
+#define VFD_CMD_RUN_CCW                 0x0022
+#define VFD_FREQ_SCALE                  100.0   // Register units per Hz
+#define VFD_CURRENT_SCALE               100.0   // Register units per A
+#define VFD_RPM_PER_HZ                  60.0    // 2-pole motor
+
+
 // Enable CoreXY kinematics. Use ONLY with CoreXY machines.
 // IMPORTANT: If homing is enabled, you must reconfigure the homing cycle #defines above to
 // #define HOMING_CYCLE_0 (1<<X_AXIS) and #define HOMING_CYCLE_1 (1<<Y_AXIS)
@@ -265,6 +331,35 @@
 // Backlash Compensation
 #define ENABLE_BACKLASH_COMPENSATION            1 // true
 
+// Rate at which backlash steps are injected by the stepper ISR after an axis reversed its direction.
+// The steps are output in addition to the regular motion steps and are not counted in the machine
+// position. Must stay within what the motors can start from standstill without losing steps.
+#define BACKLASH_STEP_RATE_HZ                   5000 // Hz
+
+
+// Electronic gearbox for spindle synchronized motion (G33/G76 and G84 rigid tapping). Once the Z-axis has
+// accelerated, every stepper tick derives the Z step target from the spindle encoder count with a
+// fixed point ratio and holds the tick, if Z is ahead. Replaces the slow PID correction of the step rate.
+// To leave headroom for spindle speed variations, the ISR runs faster than the planned feed rate by
+// EGB_TICK_SPEEDUP (Q8: 256 = planned rate, 192 = 33% faster).
+// G84 slaves the Z position to the encoder count from the first step on, including the spindle reversal
+// at the bottom. It requires a quadrature spindle encoder ($40 > 0, on a mill see ENABLE_MILL_SPINDLE_ENCODER).
+// NOTE: Comment to fall back to PID based synchronisation. G84 is not available then.
+#define ENABLE_ELECTRONIC_GEARBOX
+
+// Spindle encoder on a mill, e.g. for G84 rigid tapping. In lathe mode, the encoder is always used ($40 > 0).
+// The encoder inputs are PB6/PB7, so the Y1 limit input is not available with this. Not with ENABLE_DUAL_AXIS.
+//#define ENABLE_MILL_SPINDLE_ENCODER // Default disabled. Uncomment to enable.
+#define EGB_TICK_SPEEDUP                        192
+
+// G84 stops the spindle at R and locks Z to it at rest, so Z accelerates with the spindle. The programmed
+// spindle speed times the pitch must not exceed the maximum rate of Z.
+// Distance the spindle may carry the Z-axis past the G84 depth while stopping and reversing.
+// The cycle is aborted with an alarm beyond that. The same applies, if the encoder doesn't count for
+// RIGID_TAP_STALL_TIMEOUT during the tap.
+#define RIGID_TAP_MAX_OVERSHOOT                 2.0 // Float (mm)
+#define RIGID_TAP_STALL_TIMEOUT                 1000 // ms
+
 
 // Number of possible tools in tool table
 #define TOOLTABLE_MAX_TOOL_NR                   20 // Max tools
@@ -367,23 +462,25 @@
 #define TOOL_LENGTH_OFFSET_AXIS             Z_AXIS // Default z-axis. Valid values are X_AXIS, Y_AXIS, or Z_AXIS.
 
 
-// Enables variable spindle output voltage for different RPM values. On the Arduino Uno, the spindle
-// enable pin will output 5V for maximum RPM with 256 intermediate levels and 0V when disabled.
+// Enables variable spindle output voltage for different RPM values. The spindle PWM pin outputs
+// SPINDLE_PWM_FREQUENCY with F_TIMER_SPINDLE/SPINDLE_PWM_FREQUENCY intermediate levels and 0V when disabled.
 // NOTE: IMPORTANT for Arduino Unos! When enabled, the Z-limit pin D11 and spindle enable pin D12 switch!
 // The hardware PWM output on pin D11 is required for variable spindle output voltages.
 #define VARIABLE_SPINDLE // Default enabled. Comment to disable.
 
+// Spindle PWM frequency. Lower frequencies give a finer resolution, down to 16 bits at about 1.3-1.5 kHz.
+#define SPINDLE_PWM_FREQUENCY       10000   // Hz
+
 
 // Used by variable spindle output only. This forces the PWM output to a minimum duty cycle when enabled.
 // The PWM pin will still read 0V when the spindle is disabled. Most users will not need this option, but
 // it may be useful in certain scenarios. This minimum PWM settings coincides with the spindle rpm minimum
 // setting, like rpm max to max PWM. This is handy if you need a larger voltage difference between 0V disabled
-// and the voltage set by the minimum PWM for minimum rpm. This difference is 0.02V per PWM value. So, when
-// minimum PWM is at 1, only 0.02 volts separate enabled and disabled. At PWM 5, this would be 0.1V. Keep
-// in mind that you will begin to lose PWM resolution with increased minimum PWM values, since you have less
-// and less range over the total 255 PWM levels to signal different spindle speeds.
-// NOTE: Compute duty cycle at the minimum PWM by this equation: (% duty cycle)=(SPINDLE_PWM_MIN_VALUE/255)*100
-//#define SPINDLE_PWM_MIN_VALUE 5 // Default disabled. Uncomment to enable. Must be greater than zero. Integer (1-255).
+// and the voltage set by the minimum PWM for minimum rpm. Keep in mind that you will begin to lose PWM
+// resolution with increased minimum PWM values, since you have less range over the total PWM levels to
+// signal different spindle speeds.
+// NOTE: Compute duty cycle at the minimum PWM by this equation: (% duty cycle)=(SPINDLE_PWM_MIN_VALUE/SPINDLE_PWM_MAX_VALUE)*100
+//#define SPINDLE_PWM_MIN_VALUE 200 // Default disabled. Uncomment to enable. Must be greater than zero. Integer (1-SPINDLE_PWM_MAX_VALUE).
 
 
 // Alters the behavior of the spindle enable pin with the USE_SPINDLE_DIR_AS_ENABLE_PIN option . By default,
@@ -455,6 +552,16 @@
 #define BLOCK_BUFFER_SIZE               64 // Uncomment to override default in planner.h.
 
 
+// Adaptive slowdown for a draining planner buffer. When the stream can't keep up with many tiny
+// segments, e.g. over a slow serial link, the buffer runs almost empty and every block decelerates
+// to zero at its end. If fewer than PLANNER_SLOWDOWN_WATERMARK blocks are queued, blocks shorter
+// than PLANNER_MIN_SEGMENT_TIME are stretched in time, with a stronger reduction the emptier the
+// buffer is. The machine then moves continuously at a lower speed instead of stop-and-go.
+#define PLANNER_SLOWDOWN // Default enabled. Comment to disable.
+#define PLANNER_SLOWDOWN_WATERMARK      (BLOCK_BUFFER_SIZE/2) // Number of queued blocks
+#define PLANNER_MIN_SEGMENT_TIME        20000 // (microseconds)
+
+
 // Governs the size of the intermediary step segment buffer between the step execution algorithm
 // and the planner blocks. Each segment is set of steps executed at a constant velocity over a
 // fixed time defined by ACCELERATION_TICKS_PER_SECOND. They are computed such that the planner
@@ -464,6 +571,30 @@
 #define SEGMENT_BUFFER_SIZE             32 // Uncomment to override default in stepper.h.
 
 
+// Refills the step segment buffer from the low priority PendSV interrupt. The stepper ISR requests
+// a refill, when fewer than SEGMENT_BUFFER_REFILL_THRESHOLD segments are left. Without it, the
+// buffer is only refilled when the main loop reaches a realtime check point, so long g-code
+// parsing or blocking serial output can starve the steppers.
+// NOTE: Flash erase (EEPROM emulation) stalls all code executing from flash, including interrupts.
+#define STEPPER_PREP_IN_ISR // Default enabled. Comment to disable.
+#define SEGMENT_BUFFER_REFILL_THRESHOLD (SEGMENT_BUFFER_SIZE/2)
+
+
+// Main loop task scheduler. Every realtime check point runs the due tasks in order of priority.
+// When a pass takes longer than SCHEDULER_PASS_BUDGET_US, lower priority tasks are postponed
+// until they miss their deadline. The task budgets only affect the statistics reported by $Q.
+#define SCHEDULER_PASS_BUDGET_US        500 // (microseconds)
+#define TASK_BUDGET_REALTIME            200 // (microseconds)
+#define TASK_BUDGET_COMM                100 // (microseconds)
+#define TASK_BUDGET_ETHERNET            200 // (microseconds)
+#define TASK_BUDGET_REPORT              1000 // (microseconds)
+#define TASK_BUDGET_VFD                 100 // (microseconds)
+#define TASK_BUDGET_SCAN                200 // (microseconds)
+#define TASK_BUDGET_RECOVERY            50 // (microseconds)
+#define TASK_PERIOD_ETHERNET            1 // (milliseconds)
+#define TASK_PERIOD_RECOVERY            100 // (milliseconds)
+
+
 // Line buffer size from the serial input stream to be executed. Also, governs the size of
 // each of the startup blocks, as they are each stored as a string of this size. Make sure
 // to account for the available EEPROM at the defined memory address in settings.h and for
@@ -491,6 +622,13 @@
 #define HARD_LIMIT_FORCE_STATE_CHECK        1 // Default disabled. Uncomment to enable.
 
 
+// Limit and control pins trigger an interrupt on their first edge. Afterwards the pin is ignored for
+// INPUT_DEBOUNCE_TIME and its settled state is checked again. With HARD_LIMIT_FORCE_STATE_CHECK, a limit
+// edge only triggers, if the switch was released before, so bouncing while disengaging is ignored.
+// Pins sharing an EXTI line with another input are polled every millisecond instead.
+#define INPUT_DEBOUNCE_TIME                 2000 // us
+
+
 // Adjusts homing cycle search and locate scalars. These are the multipliers used by Grbl's
 // homing cycle to ensure the limit switches are engaged and cleared through each phase of
 // the cycle. The search phase uses the axes max-travel setting times the SEARCH_SCALAR to
@@ -549,6 +687,37 @@
 //#define ALLOW_FEED_OVERRIDE_DURING_PROBE_CYCLES // Default disabled. Uncomment to enable.
 
 
+// Scanning probe mode ($SCAN=<distance>). Probe state changes and fixed distance samples are buffered
+// and streamed to the host in binary frames of up to SCAN_FRAME_POINTS points, while motion continues.
+#define SCAN_BUFFER_SIZE                128 // Points
+#define SCAN_FRAME_POINTS               8
+
+
+// Z height map compensation ($M). Maximum number of grid points per axis. The grid is stored in NVM
+// and applied to all motions, when enabled. Needs the internal flash EEPROM (USE_EXT_EEPROM = 0).
+#define HEIGHTMAP_MAX_X                 20
+#define HEIGHTMAP_MAX_Y                 20
+
+// Grid probing ($MP). Each point is probed with the given feed rate first, then the probe backs off
+// and touches again at HEIGHTMAP_PROBE_SLOW_FEED.
+#define HEIGHTMAP_PROBE_BACKOFF         1.0  // mm
+#define HEIGHTMAP_PROBE_SLOW_FEED       20.0 // mm/min
+
+
+// Keeps the machine position, homed state and active WCS in battery backed memory, while the machine
+// is idle with the steppers holding ($1=255). After a power cycle '$RP' restores them instead of
+// homing again. Requires a battery on VBAT, otherwise the position only survives a reset.
+// While a job runs, the executing line number (N word), modal state and position are checkpointed.
+// '$RJ' reports the checkpoint, '$RJ=<line>' parses the streamed program without motion up to that
+// line, moves back to its start and continues the job from there.
+#define ENABLE_RECOVERY // Default enabled. Comment to disable.
+// Feed rate of the final Z move back into the work piece on job resume
+#define RECOVERY_PLUNGE_FEED            100.0 // mm/min
+// Machine Z position the tool is retracted to, before moving to the start of the resume line. Defaults to the
+// homing pull-off distance below machine zero, which clears the work piece on machines homing Z upwards.
+//#define RECOVERY_SAFE_Z                 -5.0 // mm. Uncomment to override.
+
+
 // Enables and configures parking motion methods upon a safety door state. Primarily for OEMs
 // that desire this feature for their integrated machines. At the moment, Grbl assumes that
 // the parking motion only involves one axis, although the parking implementation was written
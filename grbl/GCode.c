@@ -29,6 +29,8 @@
 #include "SpindleControl.h"
 #include "CoolantControl.h"
 #include "MotionControl.h"
+#include "HeightMap.h"
+#include "Recovery.h"
 #include "Protocol.h"
 #include "SpindleControl.h"
 #include "util.h"
@@ -58,6 +60,14 @@
 #define AXIS_COMMAND_MOTION_MODE            2
 #define AXIS_COMMAND_TOOL_LENGTH_OFFSET     3 // *Undefined but required
 
+// G76 threading cycle
+#define G76_MAX_PASSES                      64
+#define G76_MAX_STARTS                      16
+#define G76_TAPER_NONE                      0
+#define G76_TAPER_ENTRY                     BIT(0)  // L1
+#define G76_TAPER_EXIT                      BIT(1)  // L2
+#define G76_TAPER_BOTH                      (G76_TAPER_ENTRY | G76_TAPER_EXIT)  // L3
+
 
 // Declare gc extern struct
 Parser_State_t gc_state;
@@ -86,6 +96,12 @@ void GC_Init(void)
 void GC_SyncPosition(void)
 {
     System_ConvertArraySteps2Mpos(gc_state.position, sys_position);
+
+    if(HeightMap_IsActive())
+    {
+        // Parser works on the uncompensated position
+        gc_state.position[Z_AXIS] -= HeightMap_GetOffset(gc_state.position[X_AXIS], gc_state.position[Y_AXIS]);
+    }
 }
 
 
@@ -114,6 +130,8 @@ uint8_t GC_ExecuteLine(const char *line)
     uint8_t axis_words = 0;
     // IJK tracking
     uint8_t ijk_words = 0;
+    // G76 number of starts. Only taken from a D word, which belongs to G76.
+    uint8_t thread_starts = 1;
 
     // Initialize command and value words and parser flags variables.
 
@@ -362,7 +380,15 @@ uint8_t GC_ExecuteLine(const char *line)
             case 81:
             case 82:
             case 83:
+            case 84:
                 // Canned drilling cycles
+#ifndef ENABLE_ELECTRONIC_GEARBOX
+                if(int_value == 84)
+                {
+                    // Rigid tapping requires electronic gearbox
+                    return STATUS_GCODE_UNSUPPORTED_COMMAND;
+                }
+#endif
                 word_bit = MODAL_GROUP_G1;
                 gc_block.modal.motion = int_value;
                 axis_command = AXIS_COMMAND_MOTION_MODE;
@@ -632,6 +658,10 @@ uint8_t GC_ExecuteLine(const char *line)
             switch (letter)
             {
             case 'A':
+#ifdef ENABLE_DUAL_AXIS
+                // A axis output drives the second Y motor
+                return STATUS_GCODE_UNSUPPORTED_COMMAND;
+#endif
                 if (BIT_IS_TRUE(settings.flags_ext, BITFLAG_ENABLE_MULTI_AXIS))
                 {
                     word_bit = WORD_A;
@@ -1040,8 +1070,9 @@ uint8_t GC_ExecuteLine(const char *line)
         BIT_FALSE(value_words, BIT(WORD_P));
     }
 
-    // [10.1 Canned drilling cycle]: R/P/Q value missing.
-    if (gc_block.modal.motion == MOTION_MODE_DRILL || gc_block.modal.motion == MOTION_MODE_DRILL_DWELL || gc_block.modal.motion == MOTION_MODE_DRILL_PECK || gc_block.modal.motion == MOTION_MODE_DRILL_BREAK)
+    // [10.1 Canned drilling cycle]: R/P/Q/K value missing.
+    if (gc_block.modal.motion == MOTION_MODE_DRILL || gc_block.modal.motion == MOTION_MODE_DRILL_DWELL || gc_block.modal.motion == MOTION_MODE_DRILL_PECK ||
+        gc_block.modal.motion == MOTION_MODE_DRILL_BREAK || gc_block.modal.motion == MOTION_MODE_TAPPING)
     {
         if(BIT_IS_FALSE(value_words, BIT(WORD_R)))
         {
@@ -1070,6 +1101,23 @@ uint8_t GC_ExecuteLine(const char *line)
             // TODO: Check validity of Q
             BIT_FALSE(value_words, BIT(WORD_Q));
         }
+        if(gc_block.modal.motion == MOTION_MODE_TAPPING)
+        {
+            // Thread pitch
+            if(BIT_IS_FALSE(value_words, BIT(WORD_K)))
+            {
+                // [K word missing]
+                return STATUS_GCODE_VALUE_WORD_MISSING;
+            }
+            if(gc_block.values.ijk[Z_AXIS] <= 0.0)
+            {
+                return STATUS_BAD_NUMBER_FORMAT;
+            }
+            BIT_FALSE(value_words, BIT(WORD_K));
+
+            // [Optional] Dwell at bottom
+            BIT_FALSE(value_words, BIT(WORD_P));
+        }
 
         // TODO: Inverse time feed rate not allowed for canned cycles
         //if(gc_block.modal.feed_rate == FEED_RATE_MODE_INVERSE_TIME)
@@ -1423,13 +1471,20 @@ uint8_t GC_ExecuteLine(const char *line)
                 axis_command = AXIS_COMMAND_NONE;
             }
 
-            // All remaining motion modes (all but G0, G80, G33 and G76), require a valid feed rate value. In units per mm mode,
+            // All remaining motion modes (all but G0, G80, G33, G76 and G84), require a valid feed rate value. In units per mm mode,
             // the value must be positive. In inverse time mode, a positive value must be passed with each block.
         }
-        else if((gc_block.modal.motion == MOTION_MODE_SPINDLE_SYNC) || (gc_block.modal.motion == MOTION_MODE_THREADING))
+        else if((gc_block.modal.motion == MOTION_MODE_SPINDLE_SYNC) || (gc_block.modal.motion == MOTION_MODE_THREADING) ||
+                (gc_block.modal.motion == MOTION_MODE_TAPPING))
         {
+            // Feed rate is given by spindle speed and pitch
             switch(gc_block.modal.motion)
             {
+            case MOTION_MODE_TAPPING:
+                // [Optional] Number of repeats
+                BIT_FALSE(value_words, BIT(WORD_L));
+                break;
+
             case MOTION_MODE_SPINDLE_SYNC:
                 if(BIT_IS_FALSE(value_words, BIT(WORD_K)))
                 {
@@ -1467,7 +1522,40 @@ uint8_t GC_ExecuteLine(const char *line)
                 }
                 BIT_FALSE(value_words, (BIT(WORD_I) | BIT(WORD_J) | BIT(WORD_K)));
 
+                if(isEqual_f(gc_block.values.ijk[X_AXIS], 0.0) || gc_block.values.ijk[Y_AXIS] <= 0.0 || gc_block.values.ijk[Z_AXIS] <= 0.0 || gc_block.values.p <= 0.0)
+                {
+                    // Peak offset, depth of cut, thread depth or pitch invalid
+                    return STATUS_BAD_NUMBER_FORMAT;
+                }
+
                 // [Optional]
+                if(BIT_IS_TRUE(value_words, BIT(WORD_H)))
+                {
+                    if(gc_block.values.h > G76_MAX_PASSES/2)
+                    {
+                        return STATUS_BAD_NUMBER_FORMAT;
+                    }
+                }
+
+                if(BIT_IS_TRUE(value_words, BIT(WORD_E)))
+                {
+                    if(gc_block.values.e < 0.0)
+                    {
+                        return STATUS_BAD_NUMBER_FORMAT;
+                    }
+                }
+
+                // Number of starts
+                if(BIT_IS_TRUE(value_words, BIT(WORD_D)))
+                {
+                    if(gc_block.values.d < 1 || gc_block.values.d > G76_MAX_STARTS)
+                    {
+                        return STATUS_BAD_NUMBER_FORMAT;
+                    }
+                    thread_starts = gc_block.values.d;
+                    BIT_FALSE(value_words, BIT(WORD_D));
+                }
+
                 if(BIT_IS_TRUE(value_words, BIT(WORD_R)))
                 {
                     if(gc_block.values.r < 1.0)
@@ -1484,6 +1572,21 @@ uint8_t GC_ExecuteLine(const char *line)
                     }
                 }
 
+                // The pass schedule (same as executed) must reach the thread depth within the pass limit
+                {
+                    float regression = (gc_block.values.r < 1.0) ? 1.0 : min(gc_block.values.r, 6.0);
+                    uint8_t passes = 1;
+
+                    while(gc_block.values.ijk[Y_AXIS] * powf(passes, 1.0/regression) < gc_block.values.ijk[Z_AXIS])
+                    {
+                        if(++passes > (G76_MAX_PASSES - gc_block.values.h))
+                        {
+                            // Depth of cut too small for the thread depth
+                            return STATUS_GCODE_MAX_VALUE_EXCEEDED;
+                        }
+                    }
+                }
+
                 if(BIT_IS_TRUE(value_words, BIT(WORD_Q)))
                 {
                     if(gc_block.values.q < 0.0 || gc_block.values.q > 80)
@@ -1998,7 +2101,15 @@ uint8_t GC_ExecuteLine(const char *line)
         // Update spindle control and apply spindle speed when enabling it in this block.
         // NOTE: All spindle state changes are synced, even in laser mode. Also, pl_data,
         // rather than gc_state, is used to manage laser state for non-laser motions.
-        Spindle_Sync(gc_block.modal.spindle, pl_data->spindle_speed);
+        float rpm = pl_data->spindle_speed;
+
+        if(gc_state.modal.spindle_mode == SPINDLE_SURFACE_MODE)
+        {
+            // Start with speed at current X position
+            float x_offset = gc_state.coord_system[X_AXIS] + gc_state.coord_offset[X_AXIS] + gc_state.tool_length_offset_dynamic[X_AXIS] + gc_state.tool_length_offset[X_AXIS];
+            rpm = Spindle_SurfaceSpeedToRpm(rpm, gc_state.position[X_AXIS] - x_offset, gc_state.spindle_limit);
+        }
+        Spindle_Sync(gc_block.modal.spindle, rpm);
         gc_state.modal.spindle = gc_block.modal.spindle;
     }
 
@@ -2134,6 +2245,14 @@ uint8_t GC_ExecuteLine(const char *line)
         break;
     }
 
+    // Constant surface speed is evaluated per step segment from the X position in work coordinates
+    if(gc_state.modal.spindle_mode == SPINDLE_SURFACE_MODE)
+    {
+        pl_data->spindle_css = 1;
+        pl_data->spindle_limit = gc_state.spindle_limit;
+        pl_data->css_x_offset = gc_state.coord_system[X_AXIS] + gc_state.coord_offset[X_AXIS] + gc_state.tool_length_offset_dynamic[X_AXIS] + gc_state.tool_length_offset[X_AXIS];
+    }
+
 
     // [20. Motion modes ]:
     // NOTE: Commands G10,G28,G30,G92 lock out and prevent axis words from use in motion modes.
@@ -2309,6 +2428,104 @@ uint8_t GC_ExecuteLine(const char *line)
                 // Update position
                 memcpy(gc_block.values.xyz, xyz, N_AXIS*sizeof(float));
             }
+#ifdef ENABLE_ELECTRONIC_GEARBOX
+            else if(gc_state.modal.motion == MOTION_MODE_TAPPING)
+            {
+                float xyz[N_AXIS] = {0.0};
+                float clear_z = gc_block.values.r + gc_state.coord_system[Z_AXIS] + gc_state.coord_offset[Z_AXIS];
+                float delta_x = 0.0;
+                float delta_y = 0.0;
+                float pitch = gc_block.values.ijk[Z_AXIS];
+                uint8_t reverse = (gc_state.modal.spindle == SPINDLE_ENABLE_CW) ? SPINDLE_ENABLE_CCW : SPINDLE_ENABLE_CW;
+
+                if(gc_state.modal.spindle == SPINDLE_DISABLE)
+                {
+                    // Spindle not running
+                    return STATUS_IDLE_ERROR;
+                }
+                if(!Spindle_EncoderAvailable())
+                {
+                    // Rigid tapping needs the spindle encoder. A VFD reported speed is not enough.
+                    return STATUS_SETTING_DISABLED;
+                }
+
+                if(gc_state.modal.distance == DISTANCE_MODE_INCREMENTAL)
+                {
+                    clear_z += old_xyz[Z_AXIS];
+                    gc_block.values.xyz[Z_AXIS] = clear_z + (gc_block.values.xyz[Z_AXIS] - old_xyz[Z_AXIS]);
+
+                    delta_x = gc_block.values.xyz[X_AXIS] - old_xyz[X_AXIS];
+                    delta_y = gc_block.values.xyz[Y_AXIS] - old_xyz[Y_AXIS];
+                }
+                else
+                {
+                    clear_z += gc_state.tool_length_offset_dynamic[TOOL_LENGTH_OFFSET_AXIS] + gc_state.tool_length_offset[TOOL_LENGTH_OFFSET_AXIS];
+                }
+
+                if(clear_z < gc_block.values.xyz[Z_AXIS])
+                {
+                    // Error
+                    return STATUS_GCODE_INVALID_TARGET;
+                }
+
+                //-- [G84] --//
+                memcpy(xyz, old_xyz, N_AXIS*sizeof(float));
+
+                // 0. Check if old_z < clear_z
+                if(old_xyz[Z_AXIS] < clear_z)
+                {
+                    // Move old_z to clear_z
+                    xyz[Z_AXIS] = clear_z;
+
+                    // Set rapid motion condition flag.
+                    pl_data->condition |= PL_COND_FLAG_RAPID_MOTION;
+                    MC_Line(xyz, pl_data);
+                }
+
+                if(gc_block.values.l == 0)
+                {
+                    // Force at least one iteration of loop
+                    gc_block.values.l = 1;
+                }
+
+                for(uint8_t repeat = 0; repeat < gc_block.values.l; repeat++)
+                {
+                    // 1. Rapid move to XY (XY)
+                    xyz[X_AXIS] = gc_block.values.xyz[X_AXIS] + (delta_x*repeat);
+                    xyz[Y_AXIS] = gc_block.values.xyz[Y_AXIS] + (delta_y*repeat);
+                    // Set rapid motion condition flag.
+                    pl_data->condition |= PL_COND_FLAG_RAPID_MOTION;
+                    MC_Line(xyz, pl_data);
+
+                    // 2. Rapid move to R (Z)
+                    xyz[Z_AXIS] = clear_z;
+                    MC_Line(xyz, pl_data);
+
+                    // 3.-6. Tap to Z, reverse spindle and retract to R. Z-axis is locked to the spindle encoder
+                    // during the whole tap. Spindle is checked before entering the hole.
+                    uint8_t status = MC_RigidTap(gc_block.values.xyz[Z_AXIS] - clear_z, pitch, reverse, gc_block.values.p);
+                    if(status != STATUS_OK)
+                    {
+                        return status;
+                    }
+                    xyz[Z_AXIS] = clear_z;
+
+                    // 7. The Z-axis does a rapid move to clear Z.
+                    if((gc_state.modal.retract == RETRACT_OLD_Z) && clear_z < old_xyz[Z_AXIS])
+                    {
+                        //-- G98 --//
+                        // Retract to OLD_Z
+                        xyz[Z_AXIS] = old_xyz[Z_AXIS];
+
+                        // Set rapid motion condition flag.
+                        pl_data->condition |= PL_COND_FLAG_RAPID_MOTION;
+                        MC_Line(xyz, pl_data);
+                    }
+                }
+                // Update position
+                memcpy(gc_block.values.xyz, xyz, N_AXIS*sizeof(float));
+            }
+#endif
             else if(gc_state.modal.motion == MOTION_MODE_SPINDLE_SYNC)
             {
                 // Perform a small move towards target to trigger backlash compensation, because it could affect synchronized motion
@@ -2323,16 +2540,8 @@ uint8_t GC_ExecuteLine(const char *line)
                 pl_data->spindle_speed = rpm;
                 if(rpm > 0)
                 {
-                    // Calculate feed rate depending on current RPM along Z-axis
+                    // Calculate feed rate depending on current RPM along Z-axis. Scaled for X movement by MC_LineSync.
                     pl_data->feed_rate = rpm * gc_block.values.ijk[Z_AXIS];
-
-                    if(!isEqual_f(gc_block.values.xyz[X_AXIS], old_xyz[X_AXIS]))
-                    {
-                        // Also movement in X-axis
-                        float f = sqrtf(powf(gc_block.values.xyz[X_AXIS], 2.0) + powf(gc_block.values.ijk[Z_AXIS], 2.0));
-
-                        pl_data->feed_rate *= f;
-                    }
                 }
                 else
                 {
@@ -2349,22 +2558,50 @@ uint8_t GC_ExecuteLine(const char *line)
                 float peak = gc_block.values.ijk[X_AXIS];
                 float doc = gc_block.values.ijk[Y_AXIS];
                 float final_depth = gc_block.values.ijk[Z_AXIS];
-                float regression = min(gc_block.values.r, 6.0);
+                float regression = (gc_block.values.r < 1.0) ? 1.0 : min(gc_block.values.r, 6.0);
                 uint8_t spring_passes = gc_block.values.h;
-                float angle = gc_block.values.q;
-                //float taper_dist = gc_block.values.e;
-                //uint8_t taper_type = gc_block.values.l;
+                float tan_angle = tanf(gc_block.values.q*M_PI/180.0);
+                float taper_dist = gc_block.values.e;
+                uint8_t taper_type = gc_block.values.l;
+                uint8_t starts = thread_starts;
+
+                float depth[G76_MAX_PASSES];
+                uint8_t passes = 0;
 
-                float cur_xyz[N_AXIS];
-                memcpy(cur_xyz, old_xyz, sizeof(cur_xyz));
+                float x_drive = old_xyz[X_AXIS];
+                float x_peak = x_drive + peak;
+                float dir_x = (peak < 0.0) ? -1.0 : 1.0;   // Infeed direction: External thread (-), internal thread (+)
+                float dir_z = (gc_block.values.xyz[Z_AXIS] < old_xyz[Z_AXIS]) ? -1.0 : 1.0;
 
-                float next_doc = 0.0;
-                uint8_t leave = 0;
-                uint16_t idx = 0;
+                // Limit tapers to thread length
+                float thread_len = fabsf(gc_block.values.xyz[Z_AXIS] - old_xyz[Z_AXIS]);
+                if(taper_type == G76_TAPER_BOTH)
+                {
+                    thread_len /= 2.0;
+                }
+                taper_dist = min(taper_dist, thread_len);
+                if(taper_dist < 0.001)
+                {
+                    taper_type = G76_TAPER_NONE;
+                }
+
+                // Precompute pass schedule. Depth of pass n is doc * n^(1/R): R1 = constant depth, R2 = constant area.
+                // The number of passes was checked to fit.
+                do
+                {
+                    float d = doc * powf(passes+1, 1.0/regression);
 
-                // Calculate z offset for angled slide compensation
-                float z_offset = doc * tanf(angle*M_PI/180.0);
+                    if(d >= final_depth)
+                    {
+                        d = final_depth;
+                    }
+                    depth[passes++] = d;
+                } while(depth[passes-1] < final_depth);
 
+                for(uint8_t i = 0; i < spring_passes; i++)
+                {
+                    depth[passes++] = final_depth;
+                }
 
                 // Wait till everything is finished
                 Protocol_BufferSynchronize();
@@ -2376,14 +2613,6 @@ uint8_t GC_ExecuteLine(const char *line)
                 {
                     // Calculate feed rate depending on current RPM along Z-axis
                     pl_data->feed_rate = rpm * pitch;
-
-                    if(!isEqual_f(gc_block.values.xyz[X_AXIS], old_xyz[X_AXIS]))
-                    {
-                        // Also movement in X-axis
-                        float f = sqrtf(powf(gc_block.values.xyz[X_AXIS], 2.0) + powf(pitch, 2.0));
-
-                        pl_data->feed_rate *= f;
-                    }
                 }
                 else
                 {
@@ -2391,99 +2620,64 @@ uint8_t GC_ExecuteLine(const char *line)
                     return STATUS_IDLE_ERROR;
                 }
 
-                while((leave == 0) || (spring_passes != 0))
+                float xyz[N_AXIS];
+                float path[3][N_AXIS];
+                memcpy(xyz, old_xyz, sizeof(xyz));
+
+                for(uint8_t pass = 0; pass < passes; pass++)
                 {
-                    if(leave == 0)
-                    {
-                        idx++;
-                    }
+                    float x_cut = x_peak + dir_x*depth[pass];
+                    // Angled infeed: shift pass along Z, so only one flank cuts
+                    float z_shift = dir_z * depth[pass] * tan_angle;
+                    float z_start = old_xyz[Z_AXIS] + z_shift;
+                    float z_end = gc_block.values.xyz[Z_AXIS] + z_shift;
 
-                    if((leave == 1) && (spring_passes > 0))
+                    for(uint8_t start = 0; start < starts; start++)
                     {
-                        // Thread cutting done, only spring passes left
-                        spring_passes--;
-                    }
+                        // Rapid along drive line to start, then in to depth of cut (or thread peak for entry taper).
+                        // These moves are queued. MC_LineSyncPath waits for them to complete.
+                        pl_data->condition |= PL_COND_FLAG_RAPID_MOTION;
+                        xyz[X_AXIS] = x_drive;
+                        xyz[Z_AXIS] = z_start;
+                        MC_Line(xyz, pl_data);
 
-                    // Perform a small move towards target to trigger backlash compensation, because it could affect synchronized motion
-                    old_xyz[Z_AXIS] -= 0.001;
-                    if(leave == 0)
-                    {
-                        // Add Z offset
-                        old_xyz[Z_AXIS] -= z_offset;
-                    }
-                    MC_Line(old_xyz, pl_data);
-                    old_xyz[Z_AXIS] += 0.001;
+                        xyz[X_AXIS] = (taper_type & G76_TAPER_ENTRY) ? x_peak : x_cut;
+                        MC_Line(xyz, pl_data);
 
-                    // Rapid from drive line to depth of cut
-                    pl_data->condition |= PL_COND_FLAG_RAPID_MOTION;
-                    if(peak < 0.0)
-                    {
-                        // External thread
-                        cur_xyz[X_AXIS] = old_xyz[X_AXIS] + peak - doc - next_doc;
-                        if(cur_xyz[X_AXIS] <= (old_xyz[X_AXIS] + peak - final_depth))
+                        // Synchronized path
+                        uint8_t n = 0;
+                        if(taper_type & G76_TAPER_ENTRY)
                         {
-                            // Limit to final depth
-                            cur_xyz[X_AXIS] = old_xyz[X_AXIS] + peak - final_depth;
-                            leave = 1;
+                            memcpy(path[n], xyz, sizeof(xyz));
+                            path[n][X_AXIS] = x_cut;
+                            path[n][Z_AXIS] = z_start + dir_z*taper_dist;
+                            n++;
                         }
-                    }
-                    else if(peak > 0.0)
-                    {
-                        // Internal thread
-                        cur_xyz[X_AXIS] = old_xyz[X_AXIS] + peak + doc + next_doc;
-                        if(cur_xyz[X_AXIS] <= (old_xyz[X_AXIS] + peak + final_depth))
+                        memcpy(path[n], xyz, sizeof(xyz));
+                        path[n][X_AXIS] = x_cut;
+                        path[n][Z_AXIS] = (taper_type & G76_TAPER_EXIT) ? (z_end - dir_z*taper_dist) : z_end;
+                        n++;
+                        if(taper_type & G76_TAPER_EXIT)
                         {
-                            // Limit to final depth
-                            cur_xyz[X_AXIS] = old_xyz[X_AXIS] + peak + final_depth;
-                            leave = 1;
+                            memcpy(path[n], xyz, sizeof(xyz));
+                            path[n][X_AXIS] = x_peak;
+                            path[n][Z_AXIS] = z_end;
+                            n++;
                         }
-                    }
-                    else
-                    {
-                        // peak is zero
-                        return STATUS_BAD_NUMBER_FORMAT;
-                    }
-                    MC_Line(cur_xyz, pl_data);
-
-                    // Handle entry taper
-                    // ToDo
-
-                    Protocol_BufferSynchronize();
 
-                    // Actual synced move
-                    cur_xyz[Z_AXIS] = gc_block.values.xyz[Z_AXIS] - z_offset*(idx-1);
-                    pl_data->condition &= ~PL_COND_FLAG_RAPID_MOTION;
-                    // Sync move
-                    MC_LineSync(cur_xyz, pl_data, pitch);
-
-                    // Handle exit taper
-                    // ToDo
-
-                    // Rapid out to drive line
-                    pl_data->condition |= PL_COND_FLAG_RAPID_MOTION;
-                    cur_xyz[X_AXIS] = old_xyz[X_AXIS];
-                    MC_Line(cur_xyz, pl_data);
-
-                    // Cycle ends at end of drive line
-                    if(leave == 0 || spring_passes != 0)
-                    {
-                        //Move back to start of drive line
-                        MC_Line(old_xyz, pl_data);
-                        cur_xyz[Z_AXIS] = old_xyz[Z_AXIS];
-                    }
+                        pl_data->condition &= ~PL_COND_FLAG_RAPID_MOTION;
+                        MC_LineSyncPath(path, n, pl_data, pitch, (float)start / starts);
 
-                    // Calculate DOC of next move
-                    if(regression <= 1.0001)
-                    {
-                        // No regression defined
-                        next_doc += doc;
-                    }
-                    else
-                    {
-                        // ToDo
-                        next_doc += (1/idx) * doc;
+                        // Rapid out to drive line
+                        memcpy(xyz, path[n-1], sizeof(xyz));
+                        xyz[X_AXIS] = x_drive;
+                        pl_data->condition |= PL_COND_FLAG_RAPID_MOTION;
+                        MC_Line(xyz, pl_data);
                     }
                 }
+
+                // Cycle ends at end of drive line
+                memcpy(gc_block.values.xyz, xyz, sizeof(xyz));
             }
             else
             {
@@ -2569,6 +2763,10 @@ uint8_t GC_ExecuteLine(const char *line)
                 System_FlagWcoChange();
                 Spindle_SetState(SPINDLE_DISABLE, 0.0);
                 Coolant_SetState(COOLANT_DISABLE);
+#ifdef ENABLE_RECOVERY
+                // Job completed, nothing to resume
+                Recovery_ClearCheckpoint();
+#endif
             }
             // Reset tool change - May not be in accordance with LinuxCNC
             TC_Init();
@@ -34,7 +34,7 @@
 // and are similar/identical to other g-code interpreters by manufacturers (Haas,Fanuc,Mazak,etc).
 // NOTE: Modal group define values must be sequential and starting from zero.
 #define MODAL_GROUP_G0      0   // [G4,G10,G28,G28.1,G30,G30.1,G53,G92,G92.1] Non-modal
-#define MODAL_GROUP_G1      1   // [G0,G1,G2,G3,G33,G38.2,G38.3,G38.4,G38.5,G76,G80,G81,G82,G83] Motion
+#define MODAL_GROUP_G1      1   // [G0,G1,G2,G3,G33,G38.2,G38.3,G38.4,G38.5,G76,G80,G81,G82,G83,G84] Motion
 #define MODAL_GROUP_G2      2   // [G17,G18,G19] Plane selection
 #define MODAL_GROUP_G3      3   // [G90,G91] Distance mode
 #define MODAL_GROUP_G4      4   // [G91.1] Arc IJK distance mode
@@ -90,6 +90,7 @@
 #define MOTION_MODE_DRILL_DWELL             82  // G82
 #define MOTION_MODE_DRILL_PECK              83  // G83
 #define MOTION_MODE_DRILL_BREAK             73  // G73
+#define MOTION_MODE_TAPPING                 84  // G84
 #define MOTION_MODE_SPINDLE_SYNC            33  // G33
 #define MOTION_MODE_THREADING               76  // G76
 
@@ -0,0 +1,394 @@
+/*
+  HeightMap.c - Z height map compensation
+  Part of Grbl-Advanced
+
+  Copyright (c) 2021 Patrick F.
+
+  Grbl-Advanced is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl-Advanced is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl-Advanced.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include <math.h>
+#include "HeightMap.h"
+#include "GCode.h"
+#include "MotionControl.h"
+#include "Protocol.h"
+#include "Report.h"
+#include "Settings.h"
+#include "System.h"
+#include "util.h"
+
+
+// Avoids splitting a move twice at the same grid line due to rounding (grid units)
+#define CROSSING_EPSILON        0.0001
+
+
+static HeightMap_t height_map;
+static bool map_valid = false;
+
+// Grid being probed. Replaces the height map only when probing completed.
+static HeightMap_t probe_map;
+
+// Bilinear coefficients per cell: z = a + b*u + c*v + d*u*v, u/v = position within the cell (0..1)
+static float cell_coeff[HEIGHTMAP_MAX_Y-1][HEIGHTMAP_MAX_X-1][4];
+static float inv_spacing[2];
+
+
+static bool HeightMap_CheckGrid(const HeightMap_t *map)
+{
+    for(uint8_t i = 0; i < 2; i++)
+    {
+        if(map->spacing[i] <= 0.0 || map->points[i] < 2)
+        {
+            return false;
+        }
+    }
+
+    return (map->points[0] <= HEIGHTMAP_MAX_X) && (map->points[1] <= HEIGHTMAP_MAX_Y);
+}
+
+
+static void HeightMap_CalcCoefficients(void)
+{
+    for(uint8_t iy = 0; iy < height_map.points[1]-1; iy++)
+    {
+        for(uint8_t ix = 0; ix < height_map.points[0]-1; ix++)
+        {
+            float z00 = height_map.z[iy][ix];
+            float z10 = height_map.z[iy][ix+1];
+            float z01 = height_map.z[iy+1][ix];
+            float z11 = height_map.z[iy+1][ix+1];
+
+            cell_coeff[iy][ix][0] = z00;
+            cell_coeff[iy][ix][1] = z10 - z00;
+            cell_coeff[iy][ix][2] = z01 - z00;
+            cell_coeff[iy][ix][3] = z00 - z10 - z01 + z11;
+        }
+    }
+
+    inv_spacing[0] = 1.0 / height_map.spacing[0];
+    inv_spacing[1] = 1.0 / height_map.spacing[1];
+}
+
+
+// Converts a machine position to the cell index and the position within the cell. Positions outside
+// of the grid are clamped to the edge.
+static uint8_t HeightMap_CellPosition(float pos, uint8_t axis, float *fraction)
+{
+    float u = (pos - height_map.origin[axis]) * inv_spacing[axis];
+    float u_max = height_map.points[axis] - 1;
+
+    if(u < 0.0)
+    {
+        u = 0.0;
+    }
+    else if(u > u_max)
+    {
+        u = u_max;
+    }
+
+    uint8_t idx = (uint8_t)u;
+    if(idx > height_map.points[axis] - 2)
+    {
+        idx = height_map.points[axis] - 2;
+    }
+
+    *fraction = u - idx;
+
+    return idx;
+}
+
+
+// Next crossed grid line along one axis. Returns a value >= 1, if there is none.
+static float HeightMap_AxisCrossing(float start, float delta, float p, uint8_t axis)
+{
+    if(fabsf(delta) < 1e-9)
+    {
+        return 1.0;
+    }
+
+    float u = (start + delta*p - height_map.origin[axis]) * inv_spacing[axis];
+    int32_t line;
+
+    if(delta > 0.0)
+    {
+        line = (int32_t)floorf(u + CROSSING_EPSILON) + 1;
+        if(line < 0)
+        {
+            line = 0;
+        }
+        if(line > height_map.points[axis] - 1)
+        {
+            return 1.0;
+        }
+    }
+    else
+    {
+        line = (int32_t)ceilf(u - CROSSING_EPSILON) - 1;
+        if(line > height_map.points[axis] - 1)
+        {
+            line = height_map.points[axis] - 1;
+        }
+        if(line < 0)
+        {
+            return 1.0;
+        }
+    }
+
+    return (height_map.origin[axis] + line*height_map.spacing[axis] - start) / delta;
+}
+
+
+void HeightMap_Init(void)
+{
+    if(!Settings_ReadHeightMap(&height_map) || !HeightMap_CheckGrid(&height_map))
+    {
+        memset(&height_map, 0, sizeof(HeightMap_t));
+        map_valid = false;
+
+        return;
+    }
+
+    HeightMap_CalcCoefficients();
+    map_valid = true;
+}
+
+
+bool HeightMap_Setup(float x, float y, float spacing_x, float spacing_y, uint8_t points_x, uint8_t points_y)
+{
+    HeightMap_t map;
+
+    memset(&map, 0, sizeof(HeightMap_t));
+    map.origin[0] = x;
+    map.origin[1] = y;
+    map.spacing[0] = spacing_x;
+    map.spacing[1] = spacing_y;
+    map.points[0] = points_x;
+    map.points[1] = points_y;
+    map.enabled = height_map.enabled;
+
+    if(!HeightMap_CheckGrid(&map))
+    {
+        return false;
+    }
+
+    // Map is invalid until all points are set
+    memcpy(&height_map, &map, sizeof(HeightMap_t));
+    map_valid = false;
+
+    return true;
+}
+
+
+void HeightMap_SetPoint(uint8_t ix, uint8_t iy, float z)
+{
+    if(ix < HEIGHTMAP_MAX_X && iy < HEIGHTMAP_MAX_Y)
+    {
+        height_map.z[iy][ix] = z;
+    }
+}
+
+
+void HeightMap_Finish(void)
+{
+    if(!HeightMap_CheckGrid(&height_map))
+    {
+        return;
+    }
+
+    HeightMap_CalcCoefficients();
+    map_valid = true;
+
+    Settings_StoreHeightMap(&height_map);
+}
+
+
+void HeightMap_Clear(void)
+{
+    memset(&height_map, 0, sizeof(HeightMap_t));
+    map_valid = false;
+
+    Settings_StoreHeightMap(&height_map);
+}
+
+
+bool HeightMap_Enable(bool enable)
+{
+    if(enable && !map_valid)
+    {
+        return false;
+    }
+
+    if(height_map.enabled != enable)
+    {
+        height_map.enabled = enable;
+        Settings_StoreHeightMap(&height_map);
+    }
+
+    return true;
+}
+
+
+bool HeightMap_IsActive(void)
+{
+    return map_valid && height_map.enabled;
+}
+
+
+const HeightMap_t *HeightMap_Get(void)
+{
+    return &height_map;
+}
+
+
+// Probes Z at the X/Y position in position. Moves there at travel height, probes with feed, backs off and touches
+// again slowly. Returns false, if the probe did not trigger.
+// NOTE: Positions are machine positions from the probe, so none of the moves are compensated.
+static bool HeightMap_ProbePoint(float *position, float travel_z, float depth, float feed, float *z)
+{
+    Planner_LineData_t pl_data;
+
+    memset(&pl_data, 0, sizeof(Planner_LineData_t));
+    pl_data.condition = (PL_COND_FLAG_RAPID_MOTION | PL_COND_FLAG_NO_COMPENSATION);
+    pl_data.line_number = gc_state.line_number;
+
+    position[Z_AXIS] = travel_z;
+    MC_Line(position, &pl_data);
+
+    // Fast approach
+    pl_data.condition = PL_COND_FLAG_NO_COMPENSATION;
+    pl_data.feed_rate = feed;
+    position[Z_AXIS] = travel_z - depth;
+    if(MC_ProbeCycle(position, &pl_data, 0) != GC_PROBE_FOUND)
+    {
+        return false;
+    }
+
+    // Back off
+    System_ConvertArraySteps2Mpos(position, sys_probe_position);
+    position[Z_AXIS] += HEIGHTMAP_PROBE_BACKOFF;
+    MC_Line(position, &pl_data);
+
+    // Slow touch
+    pl_data.feed_rate = HEIGHTMAP_PROBE_SLOW_FEED;
+    position[Z_AXIS] -= 2*HEIGHTMAP_PROBE_BACKOFF;
+    if(MC_ProbeCycle(position, &pl_data, 0) != GC_PROBE_FOUND)
+    {
+        return false;
+    }
+
+    System_ConvertArraySteps2Mpos(position, sys_probe_position);
+    *z = position[Z_AXIS];
+
+    // Retract
+    pl_data.condition = (PL_COND_FLAG_RAPID_MOTION | PL_COND_FLAG_NO_COMPENSATION);
+    position[Z_AXIS] = travel_z;
+    MC_Line(position, &pl_data);
+
+    return !sys.abort;
+}
+
+
+uint8_t HeightMap_ProbeGrid(float size_x, float size_y, uint8_t points_x, uint8_t points_y, float depth, float feed)
+{
+    float position[N_AXIS];
+    float z, z_ref = 0.0;
+
+    if(points_x < 2 || points_y < 2 || depth <= 0.0 || feed <= 0.0)
+    {
+        return 1;
+    }
+
+    System_ConvertArraySteps2Mpos(position, sys_position);
+
+    float travel_z = position[Z_AXIS];
+    float spacing_x = size_x / (points_x - 1);
+    float spacing_y = size_y / (points_y - 1);
+
+    // Current map stays in use until the new one is complete
+    memset(&probe_map, 0, sizeof(HeightMap_t));
+    probe_map.origin[0] = position[X_AXIS];
+    probe_map.origin[1] = position[Y_AXIS];
+    probe_map.spacing[0] = spacing_x;
+    probe_map.spacing[1] = spacing_y;
+    probe_map.points[0] = points_x;
+    probe_map.points[1] = points_y;
+
+    if(!HeightMap_CheckGrid(&probe_map))
+    {
+        return 1;
+    }
+
+    // Rows are probed in alternating direction to shorten the travel
+    for(uint8_t iy = 0; iy < points_y; iy++)
+    {
+        for(uint8_t i = 0; i < points_x; i++)
+        {
+            uint8_t ix = (iy & 1) ? (points_x - 1 - i) : i;
+
+            position[X_AXIS] = probe_map.origin[0] + ix*spacing_x;
+            position[Y_AXIS] = probe_map.origin[1] + iy*spacing_y;
+
+            if(!HeightMap_ProbePoint(position, travel_z, depth, feed, &z))
+            {
+                GC_SyncPosition();
+
+                return 2;
+            }
+
+            if(ix == 0 && iy == 0)
+            {
+                z_ref = z;
+            }
+            probe_map.z[iy][ix] = z - z_ref;
+        }
+    }
+
+    Protocol_BufferSynchronize();
+    if(sys.abort)
+    {
+        return 2;
+    }
+
+    // Take over the new map
+    probe_map.enabled = height_map.enabled;
+    memcpy(&height_map, &probe_map, sizeof(HeightMap_t));
+    HeightMap_Finish();
+    GC_SyncPosition();
+
+    Report_HeightMap();
+
+    return 0;
+}
+
+
+float HeightMap_GetOffset(float x, float y)
+{
+    float u, v;
+    uint8_t ix = HeightMap_CellPosition(x, 0, &u);
+    uint8_t iy = HeightMap_CellPosition(y, 1, &v);
+
+    const float *c = cell_coeff[iy][ix];
+
+    return c[0] + c[1]*u + (c[2] + c[3]*u)*v;
+}
+
+
+float HeightMap_NextCrossing(const float *start, const float *delta, float p)
+{
+    float px = HeightMap_AxisCrossing(start[X_AXIS], delta[X_AXIS], p, 0);
+    float py = HeightMap_AxisCrossing(start[Y_AXIS], delta[Y_AXIS], p, 1);
+    float next = (px < py) ? px : py;
+
+    return (next < 1.0) ? next : 1.0;
+}
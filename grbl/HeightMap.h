@@ -0,0 +1,71 @@
+/*
+  HeightMap.h - Z height map compensation
+  Part of Grbl-Advanced
+
+  Copyright (c) 2021 Patrick F.
+
+  Grbl-Advanced is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl-Advanced is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl-Advanced.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef HEIGHTMAP_H
+#define HEIGHTMAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "Config.h"
+
+
+// Probed grid of Z values. Stored in NVM.
+typedef struct
+{
+    float origin[2];        // X/Y machine position of grid point 0,0 (mm)
+    float spacing[2];       // Distance between grid points in X/Y (mm)
+    uint8_t points[2];      // Number of grid points in X/Y
+    uint8_t enabled;        // Compensation is applied to motions
+    float z[HEIGHTMAP_MAX_Y][HEIGHTMAP_MAX_X];
+} HeightMap_t;
+
+
+// Loads the height map from NVM
+void HeightMap_Init(void);
+
+// Sets up an empty grid. Returns false, if the grid is invalid.
+bool HeightMap_Setup(float x, float y, float spacing_x, float spacing_y, uint8_t points_x, uint8_t points_y);
+
+void HeightMap_SetPoint(uint8_t ix, uint8_t iy, float z);
+
+// Precalculates the cell coefficients and stores the map in NVM. Must be called after all points are set.
+void HeightMap_Finish(void);
+
+void HeightMap_Clear(void);
+
+// Enables compensation. Returns false, if there is no valid map.
+bool HeightMap_Enable(bool enable);
+bool HeightMap_IsActive(void);
+
+const HeightMap_t *HeightMap_Get(void);
+
+// Probes a grid of points_x * points_y points over size_x * size_y mm, starting at the current position.
+// The current Z is the travel height, depth the maximum probing distance below it. Z values are stored
+// relative to the first point. The current map is only replaced on success. Returns 0 on success.
+uint8_t HeightMap_ProbeGrid(float size_x, float size_y, uint8_t points_x, uint8_t points_y, float depth, float feed);
+
+// Returns the interpolated Z offset at machine position x/y. Outside the grid the edge values are used.
+float HeightMap_GetOffset(float x, float y);
+
+// Returns the fraction (0..1] of the move from start to start + delta, at which the next grid line is crossed
+// after fraction p. Returns 1, if no more grid lines are crossed.
+float HeightMap_NextCrossing(const float *start, const float *delta, float p);
+
+
+#endif // HEIGHTMAP_H
@@ -33,7 +33,7 @@ uint8_t Jog_Execute(Planner_LineData_t *pl_data, const Parser_Block_t *gc_block)
     // Initialize planner data struct for jogging motions.
     // NOTE: Spindle and coolant are allowed to fully function with overrides during a jog.
     pl_data->feed_rate = gc_block->values.f;
-    pl_data->condition |= PL_COND_FLAG_NO_FEED_OVERRIDE;
+    pl_data->condition |= (PL_COND_FLAG_NO_FEED_OVERRIDE | PL_COND_FLAG_NO_COMPENSATION);
     pl_data->line_number = gc_block->values.n;
 
     if(BIT_IS_TRUE(settings.flags, BITFLAG_SOFT_LIMIT_ENABLE))
@@ -26,10 +26,12 @@
 #include "Config.h"
 #include "Settings.h"
 #include "Stepper.h"
+#include "SpindleControl.h"
 #include "Protocol.h"
 #include "Limits.h"
 #include "GPIO.h"
 #include "System32.h"
+#include "EXTI.h"
 
 
 // Homing axis search distance multiplier. Computed by this value times the cycle travel.
@@ -40,15 +42,79 @@
     #define HOMING_AXIS_LOCATE_SCALAR   5.0 // Must be > 1 to ensure limit switch is cleared.
 #endif
 
+#if defined(ENABLE_PARALLEL_HOMING) && defined(COREXY)
+    #error "ENABLE_PARALLEL_HOMING moves each motor on its own and does not support COREXY"
+#endif
+
+#ifdef ENABLE_PARALLEL_HOMING
+// Homing phases of a channel
+#define HOMING_PHASE_SEEK       0   // Search the switch at seek rate
+#define HOMING_PHASE_BACKOFF    1   // Move back to the pull-off distance from the trigger point
+#define HOMING_PHASE_LOCATE     2   // Approach the switch again at feed rate
+#define HOMING_PHASE_PULLOFF    3   // Final pull-off from the located trigger point
+#define HOMING_PHASE_DONE       4
+
+typedef struct
+{
+    uint8_t axis;
+    uint8_t phase;
+    uint8_t n_locate;       // Locate cycles done
+    int8_t approach_dir;    // +1/-1
+    float steps_per_mm;
+    float seek_rate;        // steps/s
+    float locate_rate;      // steps/s
+    float accel;            // steps/s^2
+} Limits_HomingChannel_t;
+#endif
+
 
 static uint8_t last_state = 0;
 
+// Limit bits on EXTI lines and polled by system tick
+static uint8_t exti_mask = 0;
+static uint8_t poll_mask = 0;
+// Settled state of EXTI limit pins
+static volatile uint8_t debounced_state = 0;
+// Last state and sample of polled pins
+static uint8_t poll_state = 0;
+static uint8_t poll_sample = 0;
+
+// Homing switch latch. Limit interrupts clear the axis lock bits of engaged switches during approach.
+static volatile uint8_t homing_latch = 0;
+static volatile uint8_t homing_lock = 0;
+#ifdef ENABLE_PARALLEL_HOMING
+// Lock bits are homing channels. Limit bit of the switch of each channel.
+static uint8_t homing_limit_bit[STEPPER_HOMING_CHANNELS];
+#else
+static uint8_t homing_step_pin[N_AXIS];
+#endif
+
+// Soft limit bounds (steps)
+static int32_t soft_min[N_AXIS];
+static int32_t soft_max[N_AXIS];
+
+
+static void Limits_InitExti(void);
+static void Limits_HomingLatch(uint8_t state);
+#ifdef ENABLE_PARALLEL_HOMING
+static void Limits_HomingArm(uint8_t channel);
+static bool Limits_HomeParallel(uint8_t cycle_mask);
+#else
+static uint8_t Limits_HomingSwitchMask(uint8_t cycle_mask);
+#ifdef ENABLE_DUAL_AXIS
+static bool Limits_SquareGantry(Planner_LineData_t *pl_data);
+#endif
+#endif
+
 
 void Limits_Init(void)
 {
     GPIO_InitGPIO(GPIO_LIMIT);
     last_state = 0;
 
+    Limits_InitExti();
+    Limits_UpdateSoftBounds();
+
     if (BIT_IS_TRUE(settings.flags, BITFLAG_HARD_LIMIT_ENABLE))
     {
         // Enable hard limits
@@ -68,6 +134,458 @@ void Limits_Disable(void)
 }
 
 
+// Limit pins use EXTI lines 5-8. Line 6 is shared by Y1 (PB6), Z1 (PA6) and Z2 (PC6). In lathe mode
+// Y limits are ignored and PB6 is the encoder input, so line 6 is used for Z1. The same applies to Y1 with a
+// spindle encoder on a mill. Otherwise it's used for Y1.
+// The remaining pins are polled.
+static void Limits_InitExti(void)
+{
+    Exti_ConfigLine(EXTI_PortSourceGPIOC, EXTI_PinSource7); // X1
+    Exti_ConfigLine(EXTI_PortSourceGPIOC, EXTI_PinSource8); // X2
+    Exti_ConfigLine(EXTI_PortSourceGPIOC, EXTI_PinSource5); // Y2
+
+    if (BIT_IS_TRUE(settings.flags_ext, BITFLAG_LATHE_MODE) || Spindle_EncoderAvailable())
+    {
+        Exti_ConfigLine(EXTI_PortSourceGPIOA, EXTI_PinSource6); // Z1
+        exti_mask = (1<<X1_LIMIT_BIT) | (1<<X2_LIMIT_BIT) | (1<<Y2_LIMIT_BIT) | (1<<Z1_LIMIT_BIT);
+    }
+    else
+    {
+        Exti_ConfigLine(EXTI_PortSourceGPIOB, EXTI_PinSource6); // Y1
+        exti_mask = (1<<X1_LIMIT_BIT) | (1<<X2_LIMIT_BIT) | (1<<Y2_LIMIT_BIT) | (1<<Y1_LIMIT_BIT);
+    }
+    poll_mask = LIMIT_MASK & ~exti_mask;
+
+    uint8_t state = Limits_GetState(true);
+
+    debounced_state = state & exti_mask;
+    poll_state = state & poll_mask;
+    poll_sample = poll_state;
+
+    Exti_Init9_5(2, 0);
+}
+
+
+// Edge on a limit EXTI line. Called by EXTI interrupt, after the line was masked for debouncing.
+void Limits_EdgeISR(void)
+{
+    uint8_t state = Limits_GetState(true) & exti_mask;
+
+    if (homing_latch)
+    {
+        Limits_HomingLatch(state);
+        return;
+    }
+
+    if (BIT_IS_TRUE(settings.flags_ext, BITFLAG_FORCE_HARD_LIMIT_CHECK))
+    {
+        // Only newly engaged switches
+        state &= ~debounced_state;
+    }
+
+    if (state && (sys.system_flags & BITFLAG_ENABLE_LIMITS))
+    {
+        Limit_PinChangeISR();
+    }
+}
+
+
+// Debounce time after a limit edge expired. Catches switches that engaged while the line was masked.
+void Limits_DebounceISR(void)
+{
+    uint8_t state = Limits_GetState(true) & exti_mask;
+    uint8_t engaged = state & ~debounced_state;
+
+    debounced_state = state;
+
+    if (homing_latch)
+    {
+        Limits_HomingLatch(state);
+        return;
+    }
+
+    if (engaged && (sys.system_flags & BITFLAG_ENABLE_LIMITS))
+    {
+        Limit_PinChangeISR();
+    }
+}
+
+
+// Polls the limit pins without EXTI line. Called every millisecond by the system tick.
+void Limits_PollISR(void)
+{
+    if (poll_mask == 0)
+    {
+        return;
+    }
+
+    uint8_t sample = Limits_GetState(true) & poll_mask;
+    uint8_t state = sample;
+
+    if (BIT_IS_TRUE(settings.flags_ext, BITFLAG_FORCE_HARD_LIMIT_CHECK))
+    {
+        // Must be active for two consecutive samples
+        state &= poll_sample;
+    }
+    poll_sample = sample;
+
+    uint8_t engaged = state & ~poll_state;
+    poll_state = state;
+
+    if (homing_latch)
+    {
+        Limits_HomingLatch(sample);
+        return;
+    }
+
+    if (engaged && (sys.system_flags & BITFLAG_ENABLE_LIMITS))
+    {
+        Limit_PinChangeISR();
+    }
+}
+
+
+// Locks the homing axes with engaged switches. Called by the limit interrupts during the homing approach,
+// so the axes stop within one step of the switch, independent of the main loop.
+// NOTE: Runs from SysTick (polled pins) and the EXTI/TIM2 interrupts, which preempt it. Lock bits are only
+// cleared and the update is done with interrupts disabled, so no interrupt restores a cleared bit.
+static void Limits_HomingLatch(uint8_t state)
+{
+    uint8_t lock = homing_lock;
+    uint8_t clear = 0;
+
+#ifdef ENABLE_PARALLEL_HOMING
+    // Channels decelerate to a stop on their own
+    for(uint8_t idx = 0; idx < STEPPER_HOMING_CHANNELS; idx++)
+    {
+        if((lock & BIT(idx)) && (state & BIT(homing_limit_bit[idx])))
+        {
+            Stepper_HomingStop(idx);
+            clear |= BIT(idx);
+        }
+    }
+#else
+    for(uint8_t idx = 0; idx < N_AXIS; idx++)
+    {
+#ifdef ENABLE_DUAL_AXIS
+        if(idx == A_AXIS)
+        {
+            // Output used by the second Y motor
+            continue;
+        }
+#endif
+        if((lock & homing_step_pin[idx]) && (state & (1 << idx)))
+        {
+#ifdef COREXY
+            if(idx == Z_AXIS)
+            {
+                clear |= homing_step_pin[Z_AXIS];
+            }
+            else
+            {
+                clear |= (homing_step_pin[A_MOTOR]|homing_step_pin[B_MOTOR]);
+            }
+#else
+            clear |= homing_step_pin[idx];
+#endif
+        }
+    }
+
+#ifdef ENABLE_DUAL_AXIS
+    // Second Y motor stops at its own switch
+    if(state & (1 << Y2_LIMIT_BIT))
+    {
+        clear |= homing_step_pin[A_AXIS];
+    }
+#endif
+#endif
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    homing_lock &= ~clear;
+    sys.homing_axis_lock = homing_lock;
+
+    __set_PRIMASK(primask);
+}
+
+
+#ifdef ENABLE_PARALLEL_HOMING
+// Arms the switch latch of a channel. Called after its locate or seek move started.
+static void Limits_HomingArm(uint8_t channel)
+{
+    __disable_irq();
+    homing_lock |= BIT(channel);
+    sys.homing_axis_lock = homing_lock;
+    __enable_irq();
+}
+
+
+// Homes the axes of a cycle in parallel. Each channel (step output) runs seek, back-off, locate and pull-off
+// on its own, with the rates and acceleration of its axis. With a dual axis gantry each Y motor homes to its
+// own switch and pulls off by its squaring offset. Returns false, if homing failed or was aborted.
+static bool Limits_HomeParallel(uint8_t cycle_mask)
+{
+    Limits_HomingChannel_t channel[STEPPER_HOMING_CHANNELS];
+    bool lathe = BIT_IS_TRUE(settings.flags_ext, BITFLAG_LATHE_MODE);
+    uint8_t active = 0;
+    uint8_t done = 0;
+    float fastest = 0.0;
+    uint8_t idx;
+
+    for(idx = 0; idx < STEPPER_HOMING_CHANNELS; idx++)
+    {
+        Limits_HomingChannel_t *ch = &channel[idx];
+
+        ch->axis = idx;
+        homing_limit_bit[idx] = idx;
+#ifdef ENABLE_DUAL_AXIS
+        if(idx == A_STEP_BIT)
+        {
+            // Second Y motor
+            ch->axis = Y_AXIS;
+            homing_limit_bit[idx] = Y2_LIMIT_BIT;
+        }
+#endif
+        if(BIT_IS_FALSE(cycle_mask, BIT(ch->axis)) || (lathe && ch->axis == Y_AXIS))
+        {
+            continue;
+        }
+
+        ch->phase = HOMING_PHASE_SEEK;
+        ch->n_locate = 0;
+        ch->approach_dir = BIT_IS_TRUE(settings.homing_dir_mask, BIT(ch->axis)) ? -1 : 1;
+        ch->steps_per_mm = settings.steps_per_mm[ch->axis];
+        ch->seek_rate = (min(settings.homing_seek_rate, settings.max_rate[ch->axis]) / 60.0) * ch->steps_per_mm;
+        ch->locate_rate = (min(settings.homing_feed_rate, settings.max_rate[ch->axis]) / 60.0) * ch->steps_per_mm;
+        ch->accel = (settings.acceleration[ch->axis] / (60.0 * 60.0)) * ch->steps_per_mm;
+
+        fastest = max(fastest, ch->seek_rate);
+        active |= BIT(idx);
+    }
+
+    if(active == 0)
+    {
+        return true;
+    }
+
+    for(idx = 0; idx < N_AXIS; idx++)
+    {
+        if(BIT_IS_TRUE(cycle_mask, BIT(idx)))
+        {
+            sys_position[idx] = 0;
+        }
+    }
+
+    __disable_irq();
+    homing_lock = 0;
+    homing_latch = 1;
+    __enable_irq();
+
+    Stepper_HomingInit(fastest);
+    System_ClearExecStateFlag(EXEC_CYCLE_STOP);
+    Stepper_WakeUp();
+
+    // Seek all channels. Ensure homing switches engaged with search scalar.
+    // NOTE: settings.max_travel[] is stored as a negative value.
+    for(idx = 0; idx < STEPPER_HOMING_CHANNELS; idx++)
+    {
+        Limits_HomingChannel_t *ch = &channel[idx];
+
+        if(active & BIT(idx))
+        {
+            int32_t steps = lroundf((-HOMING_AXIS_SEARCH_SCALAR) * settings.max_travel[ch->axis] * ch->steps_per_mm);
+
+            Stepper_HomingMove(idx, ch->approach_dir * steps, ch->seek_rate, ch->accel);
+            Limits_HomingArm(idx);
+        }
+    }
+
+    // Switches engaged already stop their channel right away
+    __disable_irq();
+    Limits_HomingLatch(Limits_GetState(true));
+    __enable_irq();
+
+    while(done != active)
+    {
+        if(sys_rt_exec_state & (EXEC_RESET | EXEC_SAFETY_DOOR))
+        {
+            System_SetExecAlarm((sys_rt_exec_state & EXEC_RESET) ? EXEC_ALARM_HOMING_FAIL_RESET : EXEC_ALARM_HOMING_FAIL_DOOR);
+            break;
+        }
+
+        for(idx = 0; idx < STEPPER_HOMING_CHANNELS; idx++)
+        {
+            Limits_HomingChannel_t *ch = &channel[idx];
+
+            if(!(active & BIT(idx)) || (done & BIT(idx)) || Stepper_HomingBusy(idx))
+            {
+                continue;
+            }
+
+            int32_t position = Stepper_HomingPosition(idx);
+            int32_t trigger;
+            bool triggered = Stepper_HomingTriggered(idx, &trigger);
+            bool engaged = (Limits_GetState(true) & BIT(homing_limit_bit[idx])) != 0;
+            float pulloff = settings.homing_pulloff;
+
+            switch(ch->phase)
+            {
+            case HOMING_PHASE_SEEK:
+            case HOMING_PHASE_LOCATE:
+                if(!triggered)
+                {
+                    // Homing failure condition: Limit switch not found during approach.
+                    System_SetExecAlarm(EXEC_ALARM_HOMING_FAIL_APPROACH);
+                    break;
+                }
+
+                if(ch->phase == HOMING_PHASE_LOCATE && ++ch->n_locate >= N_HOMING_LOCATE_CYCLE)
+                {
+#ifdef ENABLE_DUAL_AXIS
+                    if(ch->axis == Y_AXIS)
+                    {
+                        // Each motor moves by its squaring offset
+                        pulloff += max(settings.gantry_offset[(idx == A_STEP_BIT) ? 1 : 0], 0.0);
+                    }
+#endif
+                    ch->phase = HOMING_PHASE_PULLOFF;
+                }
+                else
+                {
+                    ch->phase = HOMING_PHASE_BACKOFF;
+                }
+
+                // Back to the pull-off distance from the trigger point. Covers the overtravel while stopping.
+                Stepper_HomingMove(idx, (trigger - position) - ch->approach_dir * lroundf(pulloff * ch->steps_per_mm),
+                                   ch->seek_rate, ch->accel);
+                break;
+
+            case HOMING_PHASE_BACKOFF:
+                if(engaged)
+                {
+                    // Homing failure condition: Limit switch still engaged after pull-off motion
+                    System_SetExecAlarm(EXEC_ALARM_HOMING_FAIL_PULLOFF);
+                    break;
+                }
+
+                ch->phase = HOMING_PHASE_LOCATE;
+                Stepper_HomingMove(idx, ch->approach_dir * lroundf(pulloff * HOMING_AXIS_LOCATE_SCALAR * ch->steps_per_mm),
+                                   ch->locate_rate, ch->accel);
+                Limits_HomingArm(idx);
+                break;
+
+            default:
+                if(engaged)
+                {
+                    System_SetExecAlarm(EXEC_ALARM_HOMING_FAIL_PULLOFF);
+                    break;
+                }
+
+                ch->phase = HOMING_PHASE_DONE;
+                done |= BIT(idx);
+                break;
+            }
+        }
+
+        if(sys_rt_exec_alarm)
+        {
+            break;
+        }
+    }
+
+    homing_latch = 0;
+
+    // Stop motors, if they are running. MC_Reset() doesn't, if a reset is pending already.
+    Stepper_Reset();
+
+    if(sys_rt_exec_alarm)
+    {
+        MC_Reset();
+        Protocol_ExecuteRealtime();
+
+        return false;
+    }
+
+
+    return true;
+}
+#endif
+
+
+#ifndef ENABLE_PARALLEL_HOMING
+// Limit switches used by the axes of a homing cycle
+static uint8_t Limits_HomingSwitchMask(uint8_t cycle_mask)
+{
+#ifdef ENABLE_DUAL_AXIS
+    if(BIT_IS_TRUE(cycle_mask, BIT(Y_AXIS)))
+    {
+        return cycle_mask | (1 << Y2_LIMIT_BIT);
+    }
+#endif
+
+    return cycle_mask;
+}
+
+
+#ifdef ENABLE_DUAL_AXIS
+// Moves each Y motor by its squaring offset away from its switch, one after another. The other motor is
+// locked meanwhile. Returns false, if homing was aborted.
+static bool Limits_SquareGantry(Planner_LineData_t *pl_data)
+{
+    const uint8_t motor_pin[2] = {homing_step_pin[Y_AXIS], homing_step_pin[A_AXIS]};
+    float target[N_AXIS];
+
+    for(uint8_t motor = 0; motor < 2; motor++)
+    {
+        if(settings.gantry_offset[motor] <= 0.0)
+        {
+            continue;
+        }
+
+        System_ConvertArraySteps2Mpos(target, sys_position);
+        if(BIT_IS_TRUE(settings.homing_dir_mask, BIT(Y_AXIS)))
+        {
+            target[Y_AXIS] += settings.gantry_offset[motor];
+        }
+        else
+        {
+            target[Y_AXIS] -= settings.gantry_offset[motor];
+        }
+
+        sys.homing_axis_lock = motor_pin[motor];
+
+        pl_data->feed_rate = settings.homing_feed_rate;
+        Planner_BufferLine(target, pl_data);
+
+        sys.step_control = STEP_CONTROL_EXECUTE_SYS_MOTION;
+        Stepper_PrepareBuffer();
+        Stepper_WakeUp();
+
+        while(!(sys_rt_exec_state & EXEC_CYCLE_STOP))
+        {
+            Stepper_PrepareBuffer();
+
+            if(sys_rt_exec_state & (EXEC_RESET | EXEC_SAFETY_DOOR))
+            {
+                System_SetExecAlarm((sys_rt_exec_state & EXEC_RESET) ? EXEC_ALARM_HOMING_FAIL_RESET : EXEC_ALARM_HOMING_FAIL_DOOR);
+                MC_Reset();
+                Protocol_ExecuteRealtime();
+
+                return false;
+            }
+        }
+
+        System_ClearExecStateFlag(EXEC_CYCLE_STOP);
+        Stepper_Reset();
+    }
+
+    return true;
+}
+#endif
+#endif
+
+
 // Returns limit state as a bit-wise uint8 variable. Each bit indicates an axis limit, where
 // triggered is 1 and not triggered is 0. Invert mask is applied. Axes are defined by their
 // number in bit position, i.e. Z_AXIS is (1<<2) or bit 2, and Y_AXIS is (1<<1) or bit 1.
@@ -95,6 +613,11 @@ uint8_t Limits_GetState(bool held)
         // Clear Y-Limits in lathe mode
         limit_state &= ~(1 << Y1_LIMIT_BIT | 1 << Y2_LIMIT_BIT);
     }
+    else if(Spindle_EncoderAvailable())
+    {
+        // Y1 input is the spindle encoder
+        limit_state &= ~(1 << Y1_LIMIT_BIT);
+    }
 
     uint8_t tmp_state = limit_state ^ last_state;
     tmp_state &= limit_state;
@@ -134,7 +657,7 @@ void Limit_PinChangeISR(void) // DEFAULT: Limit pin change interrupt process.
         {
             if (BIT_IS_TRUE(settings.flags_ext, BITFLAG_FORCE_HARD_LIMIT_CHECK))
             {
-                Delay_ms(2);
+                // Callers already debounced the pins
                 uint8_t lim = Limits_GetState(true);
 
                 // Check limit pin state.
@@ -171,6 +694,14 @@ void Limits_GoHome(uint8_t cycle_mask)
         return;
     }
 
+    uint8_t idx;
+
+#ifdef ENABLE_PARALLEL_HOMING
+    if(!Limits_HomeParallel(cycle_mask))
+    {
+        return;
+    }
+#else
     // Initialize plan data struct for homing motion. Spindle and coolant are disabled.
     Planner_LineData_t plan_data;
     Planner_LineData_t *pl_data = &plan_data;
@@ -180,10 +711,9 @@ void Limits_GoHome(uint8_t cycle_mask)
 
     // Initialize variables used for homing computations.
     uint8_t n_cycle = (2*N_HOMING_LOCATE_CYCLE+1);
-    uint8_t step_pin[N_AXIS];
+    uint8_t *step_pin = homing_step_pin;
     float target[N_AXIS];
     float max_travel = 0.0;
-    uint8_t idx;
     for(idx = 0; idx < N_AXIS; idx++)
     {
         // Initialize step pin masks
@@ -208,7 +738,7 @@ void Limits_GoHome(uint8_t cycle_mask)
     bool approach = true;
     float homing_rate = settings.homing_seek_rate;
 
-    uint8_t limit_state, axislock, n_active_axis;
+    uint8_t axislock, n_active_axis;
     do
     {
         System_ConvertArraySteps2Mpos(target,sys_position);
@@ -267,12 +797,19 @@ void Limits_GoHome(uint8_t cycle_mask)
                 }
                 // Apply axislock to the step port pins active in this cycle.
                 axislock |= step_pin[idx];
+#ifdef ENABLE_DUAL_AXIS
+                if(idx == Y_AXIS)
+                {
+                    axislock |= step_pin[A_AXIS];
+                }
+#endif
             }
 
         }
 
         // [sqrtf(N_AXIS)] Adjust so individual axes all move at homing rate.
         homing_rate *= sqrtf(n_active_axis);
+        homing_lock = axislock;
         sys.homing_axis_lock = axislock;
 
         // Perform homing cycle. Planner buffer should be empty, as required to initiate the homing cycle.
@@ -283,6 +820,16 @@ void Limits_GoHome(uint8_t cycle_mask)
         sys.step_control = STEP_CONTROL_EXECUTE_SYS_MOTION;
         // Prep and fill segment buffer from newly planned block.
         Stepper_PrepareBuffer();
+        if(approach)
+        {
+            // Limit interrupts lock out the cycle axes, when their switch engages. Switches engaged
+            // already are locked right away.
+            __disable_irq();
+            homing_latch = 1;
+            Limits_HomingLatch(Limits_GetState(true));
+            __enable_irq();
+        }
+
         // Initiate motion
         Stepper_WakeUp();
 
@@ -290,31 +837,7 @@ void Limits_GoHome(uint8_t cycle_mask)
         {
             if(approach)
             {
-                // Check limit state. Lock out cycle axes when they change.
-                limit_state = Limits_GetState(true);
-                for(idx = 0; idx < N_AXIS; idx++)
-                {
-                    if(axislock & step_pin[idx])
-                    {
-                        if(limit_state & (1 << idx))
-                        {
-#ifdef COREXY
-                            if(idx == Z_AXIS)
-                            {
-                                axislock &= ~(step_pin[Z_AXIS]);
-                            }
-                            else
-                            {
-                                axislock &= ~(step_pin[A_MOTOR]|step_pin[B_MOTOR]);
-                            }
-#else
-                            axislock &= ~(step_pin[idx]);
-#endif
-                        }
-                    }
-                }
-
-                sys.homing_axis_lock = axislock;
+                axislock = homing_lock;
             }
 
             // Check and prep segment buffer. NOTE: Should take no longer than 200us.
@@ -336,7 +859,7 @@ void Limits_GoHome(uint8_t cycle_mask)
                     System_SetExecAlarm(EXEC_ALARM_HOMING_FAIL_DOOR);
                 }
                 // Homing failure condition: Limit switch still engaged after pull-off motion
-                if(!approach && (Limits_GetState(true) & cycle_mask))
+                if(!approach && (Limits_GetState(true) & Limits_HomingSwitchMask(cycle_mask)))
                 {
                     System_SetExecAlarm(EXEC_ALARM_HOMING_FAIL_PULLOFF);
                 }
@@ -347,6 +870,7 @@ void Limits_GoHome(uint8_t cycle_mask)
                 }
                 if(sys_rt_exec_alarm)
                 {
+                    homing_latch = 0;
                     // Stop motors, if they are running.
                     MC_Reset();
                     Protocol_ExecuteRealtime();
@@ -364,10 +888,16 @@ void Limits_GoHome(uint8_t cycle_mask)
         }
         while(0x3F & axislock);
 
+        homing_latch = 0;
+
         // Immediately force kill steppers and reset step segment buffer.
         Stepper_Reset();
-        // Delay to allow transient dynamics to dissipate.
-        Delay_ms(settings.homing_debounce_delay);
+        if(approach)
+        {
+            // Delay to allow transient dynamics of the hard stop to dissipate. Pull-off motions
+            // decelerate normally.
+            Delay_ms(settings.homing_debounce_delay);
+        }
 
         // Reverse direction and reset homing rate for locate cycle(s).
         approach = !approach;
@@ -387,6 +917,17 @@ void Limits_GoHome(uint8_t cycle_mask)
     }
     while(n_cycle-- > 0);
 
+#ifdef ENABLE_DUAL_AXIS
+    if(BIT_IS_TRUE(cycle_mask, BIT(Y_AXIS)))
+    {
+        if(!Limits_SquareGantry(pl_data))
+        {
+            return;
+        }
+    }
+#endif
+#endif
+
     // The active cycle axes should now be homed and machine limits have been located. By
     // default, Grbl defines machine space as all negative, as do most CNCs. Since limit switches
     // can be on either side of an axes, check and set axes machine zero appropriately. Also,
@@ -406,13 +947,21 @@ void Limits_GoHome(uint8_t cycle_mask)
             }
             else
             {
+                float pulloff = settings.homing_pulloff;
+#ifdef ENABLE_DUAL_AXIS
+                if (idx == Y_AXIS)
+                {
+                    // First Y motor moved by its squaring offset
+                    pulloff += settings.gantry_offset[0];
+                }
+#endif
                 if (BIT_IS_TRUE(settings.homing_dir_mask, BIT(idx)))
                 {
-                    set_axis_position = lroundf((settings.max_travel[idx] + settings.homing_pulloff) * settings.steps_per_mm[idx]);
+                    set_axis_position = lroundf((settings.max_travel[idx] + pulloff) * settings.steps_per_mm[idx]);
                 }
                 else
                 {
-                    set_axis_position = lroundf(-settings.homing_pulloff * settings.steps_per_mm[idx]);
+                    set_axis_position = lroundf(-pulloff * settings.steps_per_mm[idx]);
                 }
             }
 #ifdef COREXY
@@ -438,8 +987,8 @@ void Limits_GoHome(uint8_t cycle_mask)
         }
     }
 
-    // Necessary for backlash compensation
-    MC_Init();
+    // Play is taken up in pull-off direction now
+    Stepper_ResetBacklash();
 
     // Return step control to normal operation.
     sys.step_control = STEP_CONTROL_NORMAL_OP;
@@ -455,31 +1004,74 @@ void Limits_SoftCheck(const float *target)
 {
     if(System_CheckTravelLimits(target))
     {
-        sys.soft_limit = true;
+        Limits_SoftLimitError();
+    }
+}
+
+
+// Same bounds as System_CheckTravelLimits. Rounding is the same as for planner target steps, so
+// every target passing the check in mm also passes in steps.
+void Limits_UpdateSoftBounds(void)
+{
+    for(uint8_t idx = 0; idx < N_AXIS; idx++)
+    {
+        // NOTE: max_travel is stored as negative
+        int32_t travel = lroundf(settings.max_travel[idx]*settings.steps_per_mm[idx]);
 
-        // Force feed hold if cycle is active. All buffered blocks are guaranteed to be within
-        // workspace volume so just come to a controlled stop so position is not lost. When complete
-        // enter alarm mode.
-        if(sys.state == STATE_CYCLE)
+        if(BIT_IS_TRUE(settings.flags_ext, BITFLAG_HOMING_FORCE_SET_ORIGIN) && BIT_IS_TRUE(settings.homing_dir_mask, BIT(idx)))
         {
-            System_SetExecStateFlag(EXEC_FEED_HOLD);
-            do
-            {
-                Protocol_ExecuteRealtime();
+            soft_min[idx] = 0;
+            soft_max[idx] = -travel;
+        }
+        else
+        {
+            soft_min[idx] = travel;
+            soft_max[idx] = 0;
+        }
+    }
+}
 
-                if(sys.abort)
-                {
-                    return;
-                }
-            }
-            while(sys.state != STATE_IDLE);
+
+bool Limits_SoftCheckSteps(const int32_t *target_steps)
+{
+    for(uint8_t idx = 0; idx < N_AXIS; idx++)
+    {
+        if(target_steps[idx] < soft_min[idx] || target_steps[idx] > soft_max[idx])
+        {
+            return true;
         }
+    }
 
-        // Issue system reset and ensure spindle and coolant are shutdown.
-        MC_Reset();
-        // Indicate soft limit critical event
-        System_SetExecAlarm(EXEC_ALARM_SOFT_LIMIT);
-        // Execute to enter critical event loop and system abort
-        Protocol_ExecuteRealtime();
+    return false;
+}
+
+
+void Limits_SoftLimitError(void)
+{
+    sys.soft_limit = true;
+
+    // Force feed hold if cycle is active. All buffered blocks are guaranteed to be within
+    // workspace volume so just come to a controlled stop so position is not lost. When complete
+    // enter alarm mode.
+    if(sys.state == STATE_CYCLE)
+    {
+        System_SetExecStateFlag(EXEC_FEED_HOLD);
+        do
+        {
+            Protocol_ExecuteRealtime();
+
+            if(sys.abort)
+            {
+                return;
+            }
+        }
+        while(sys.state != STATE_IDLE);
     }
+
+    // Issue system reset and ensure spindle and coolant are shutdown.
+    MC_Reset();
+    // Indicate soft limit critical event
+    System_SetExecAlarm(EXEC_ALARM_SOFT_LIMIT);
+    // Execute to enter critical event loop and system abort
+    Protocol_ExecuteRealtime();
 }
@@ -23,6 +23,7 @@
 #define LIMITS_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 
 // Initialize the limits module
@@ -36,11 +37,25 @@ uint8_t Limits_GetState(bool held);
 
 void Limit_PinChangeISR(void);
 
+// Limit pin interrupt handlers. EdgeISR and DebounceISR for pins on EXTI lines, PollISR for the remaining pins.
+void Limits_EdgeISR(void);
+void Limits_DebounceISR(void);
+void Limits_PollISR(void);
+
 // Perform one portion of the homing cycle based on the input settings.
 void Limits_GoHome(uint8_t cycle_mask);
 
 // Check for soft limit violations
 void Limits_SoftCheck(const float *target);
 
+// Precalculates the soft limit bounds in steps. Called on init and when settings change.
+void Limits_UpdateSoftBounds(void);
+
+// Returns true, if the target (in steps) is outside of the soft limits. Called by planner for every block.
+bool Limits_SoftCheckSteps(const int32_t *target_steps);
+
+// Stops motion and raises soft limit alarm
+void Limits_SoftLimitError(void);
+
 
 #endif // LIMITS_H
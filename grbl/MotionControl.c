@@ -19,15 +19,19 @@
   You should have received a copy of the GNU General Public License
   along with Grbl-Advanced.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <stdlib.h>
 #include <string.h>
 #include "Settings.h"
 #include "System.h"
 #include "Config.h"
 #include "GCode.h"
+#include "HeightMap.h"
 #include "Probe.h"
+#include "ProbeScan.h"
 #include "Limits.h"
 #include "System32.h"
 #include "Protocol.h"
+#include "Scheduler.h"
 #include "SpindleControl.h"
 #include "Stepper.h"
 #include "Report.h"
@@ -39,45 +43,21 @@
 #include "Print.h"
 
 
-#define DIR_POSITIV     0
-#define DIR_NEGATIV     1
-
-
-// Backlash compensation
-static float target_prev[N_AXIS] = {0.0};
-static uint8_t dir_negative[N_AXIS] = {DIR_NEGATIV};
-static uint8_t backlash_enable = 0;
-
 // Sync move
 static int32_t pos_z = 0;
 static volatile uint8_t wait_spindle = 0;
 static uint8_t start_sync = 0;
-static uint16_t enc_cnt_prev = 0;
-static uint32_t EncValue = 0;
+static uint32_t enc_start = 0;
 static float sync_pitch = 0.0;
 
 static float in = 0.0, out = 0.0, set = 0.0;
 static PID_t pid;
 
+extern uint32_t millis(void);
+
 
 void MC_Init(void)
 {
-    for(uint8_t i = 0; i < N_AXIS; i++)
-    {
-        dir_negative[i] = (settings.homing_dir_mask >> i) & 0x1;
-    }
-
-    MC_SyncBacklashPosition();
-
-    for(uint8_t i = 0; i < N_AXIS; i++)
-    {
-        // Don't do backlash move, if all axis are 0.0
-        if(settings.backlash[i] > 0.0001)
-        {
-            backlash_enable = 1;
-        }
-    }
-
     PID_Create(&pid, &in, &out, &set, 1.8, 22, 0.08);
     PID_Limits(&pid, -0.7, 0.7);
     PID_EnableAuto(&pid);
@@ -85,69 +65,14 @@ void MC_Init(void)
     pos_z = 0;
     wait_spindle = 0;
     start_sync = 0;
-    enc_cnt_prev = 0;
+    enc_start = 0;
     sync_pitch = 0;
-    EncValue = 0;
-}
-
-
-void MC_SyncBacklashPosition(void)
-{
-    // Update target_prev
-    System_ConvertArraySteps2Mpos(target_prev, sys_position);
 }
 
 
-// Execute linear motion in absolute millimeter coordinates. Feed rate given in millimeters/second
-// unless invert_feed_rate is true. Then the feed_rate means that the motion should be completed in
-// (1 minute)/feed_rate time.
-// NOTE: This is the primary gateway to the grbl planner. All line motions, including arc line
-// segments, must pass through this routine before being passed to the planner. The seperation of
-// mc_line and plan_buffer_line is done primarily to place non-planner-type functions from being
-// in the planner and to let backlash compensation or canned cycle integration simple and direct.
-void MC_Line(const float *target, const Planner_LineData_t *pl_data)
+// Waits for room in the planner buffer and queues the motion
+static void MC_BufferLine(const float *target, const Planner_LineData_t *pl_data)
 {
-    //uint8_t backlash_update = 0;
-    float target_new[N_AXIS] = {};
-    Planner_LineData_t pl_data_new;
-
-    memcpy(target_new, target, sizeof(float)*N_AXIS);
-    memcpy(&pl_data_new, pl_data, sizeof(Planner_LineData_t));
-
-    pl_data_new.backlash_motion = 0;
-
-    // If enabled, check for soft limit violations. Placed here all line motions are picked up
-    // from everywhere in Grbl.
-    if(BIT_IS_TRUE(settings.flags, BITFLAG_SOFT_LIMIT_ENABLE))
-    {
-        // NOTE: Block jog state. Jogging is a special case and soft limits are handled independently.
-        if(sys.state != STATE_JOG)
-        {
-            Limits_SoftCheck(target);
-        }
-    }
-
-    // If in check gcode mode, prevent motion by blocking planner. Soft limits still work.
-    if(sys.state == STATE_CHECK_MODE)
-    {
-        return;
-    }
-
-    // NOTE: Backlash compensation may be installed here. It will need direction info to track when
-    // to insert a backlash line motion(s) before the intended line motion and will require its own
-    // plan_check_full_buffer() and check for system abort loop. Also for position reporting
-    // backlash steps will need to be also tracked, which will need to be kept at a system level.
-    // There are likely some other things that will need to be tracked as well. However, we feel
-    // that backlash compensation should NOT be handled by Grbl itself, because there are a myriad
-    // of ways to implement it and can be effective or ineffective for different CNC machines. This
-    // would be better handled by the interface as a post-processor task, where the original g-code
-    // is translated and inserts backlash motions that best suits the machine.
-    // NOTE: Perhaps as a middle-ground, all that needs to be sent is a flag or special command that
-    // indicates to Grbl what is a backlash compensation motion, so that Grbl executes the move but
-    // doesn't update the machine position values. Since the position values used by the g-code
-    // parser and planner are separate from the system machine positions, this is doable.
-
-
     // If the buffer is full: good! That means we are well ahead of the robot.
     // Remain in this loop until there is room in the buffer.
     do
@@ -171,128 +96,150 @@ void MC_Line(const float *target, const Planner_LineData_t *pl_data)
         }
     } while(1);
 
-    if (BIT_IS_TRUE(settings.flags_ext, BITFLAG_ENABLE_BACKLASH_COMP))
-    {
-        float delta_prev[N_AXIS] = {};
-        float vec_norm[N_AXIS] = {};
+    // Plan and queue motion into planner buffer
+    uint8_t plan_status = Planner_BufferLine(target, pl_data);
 
-        // Backlash compensation (not for A & B)
-        for (uint8_t i = 0; i < N_LINEAR_AXIS; i++)
+    if(plan_status == PLAN_SOFT_LIMIT)
+    {
+        Limits_SoftLimitError();
+    }
+    else if(plan_status == PLAN_EMPTY_BLOCK)
+    {
+        if(BIT_IS_TRUE(settings.flags, BITFLAG_LASER_MODE))
         {
-            delta_prev[i] = target[i] - target_prev[i];
-            vec_norm[i] = 0.0;
-            pl_data_new.backlash[i] = 0.0;
-
-            // Move positive?
-            if (target[i] > target_prev[i])
-            {
-                // Last move negative?
-                if (dir_negative[i] == DIR_NEGATIV)
-                {
-                    dir_negative[i] = DIR_POSITIV;
-                    target_new[i] += settings.backlash[i];
-                    vec_norm[i] = settings.backlash[i];
-                    pl_data_new.backlash[i] = -settings.backlash[i];
-                    current_backlash[i] += settings.backlash[i] * settings.steps_per_mm[i];
-
-                    pl_data_new.backlash_motion |= BIT(i);
-                }
-            }
-            // Move negative?
-            else if (target[i] < target_prev[i])
+            // Correctly set spindle state, if there is a coincident position passed. Forces a buffer
+            // sync while in M3 laser mode only.
+            if (pl_data->condition & PL_COND_FLAG_SPINDLE_CW)
             {
-                // Last move positive?
-                if (dir_negative[i] == DIR_POSITIV)
-                {
-                    dir_negative[i] = DIR_NEGATIV;
-                    target_new[i] -= settings.backlash[i];
-                    vec_norm[i] = -settings.backlash[i];
-                    pl_data_new.backlash[i] = settings.backlash[i];
-                    current_backlash[i] -= (settings.backlash[i] * settings.steps_per_mm[i]);
-
-                    pl_data_new.backlash_motion |= BIT(i);
-                }
+                Spindle_Sync(PL_COND_FLAG_SPINDLE_CW, pl_data->spindle_speed);
             }
         }
+    }
+}
 
-        if (backlash_enable && pl_data_new.backlash_motion)
-        {
-            float vec_len = sqrtf(powf(delta_prev[X_AXIS], 2.0) + powf(delta_prev[Y_AXIS], 2.0) + powf(delta_prev[Z_AXIS], 2.0));
 
-            pl_data_new.feed_rate *= 1.1;
+// Splits the motion at the height map grid lines and adds the interpolated Z offset to each part.
+// The planner position contains the offset of the previous target, so it is removed to get the
+// programmed start position.
+static void MC_HeightMapLine(const float *target, const Planner_LineData_t *pl_data)
+{
+    Planner_LineData_t pl_segment;
+    float start[N_AXIS], delta[N_AXIS], segment[N_AXIS];
+    float p = 0.0;
 
-            // Normalize target vector and reduce to a length of 0.1 and add it to previous target
-            for (uint8_t i = 0; i < N_LINEAR_AXIS; i++)
-            {
-                vec_norm[i] += ((delta_prev[i] / vec_len) / 10.0) + target_prev[i];
-            }
+    memcpy(&pl_segment, pl_data, sizeof(Planner_LineData_t));
 
-            // Perform backlash move if necessary
-            if (vec_len > 0.1)
+    Planner_GetPosition(start);
+    start[Z_AXIS] -= HeightMap_GetOffset(start[X_AXIS], start[Y_AXIS]);
+
+    for(uint8_t idx = 0; idx < N_AXIS; idx++)
+    {
+        delta[idx] = target[idx] - start[idx];
+    }
+
+    while(p < 1.0)
+    {
+        float p_next = HeightMap_NextCrossing(start, delta, p);
+
+        if(p_next < 1.0)
+        {
+            for(uint8_t idx = 0; idx < N_AXIS; idx++)
             {
-                Planner_BufferLine(vec_norm, &pl_data_new);
-                pl_data_new.backlash_motion = 0;
+                segment[idx] = start[idx] + delta[idx]*p_next;
             }
         }
+        else
+        {
+            memcpy(segment, target, sizeof(segment));
+        }
+        segment[Z_AXIS] += HeightMap_GetOffset(segment[X_AXIS], segment[Y_AXIS]);
 
-        // Save target for next function call
-        memcpy(target_prev, target, N_AXIS*sizeof(float));
-
-        // Backlash move needs a slot in planner buffer, so we have to check again, if planner is free
-        do
+        if(pl_data->condition & PL_COND_FLAG_INVERSE_TIME)
         {
-            Protocol_ExecuteRealtime(); // Check for any run-time commands
+            // Each part has to finish in its share of the programmed time
+            pl_segment.feed_rate = pl_data->feed_rate / (p_next - p);
+        }
 
-            if (sys.abort)
-            {
-                // Bail, if system abort.
-                return;
-            }
+        MC_BufferLine(segment, &pl_segment);
 
-            if (Planner_CheckBufferFull())
-            {
-                // Auto-cycle start when buffer is full.
-                Protocol_AutoCycleStart();
-            }
-            else
-            {
-                break;
-            }
-        } while(1);
+        if(sys.abort)
+        {
+            return;
+        }
+
+        p = p_next;
     }
+}
+
 
-    if(pl_data_new.backlash_motion != 0)
+// Execute linear motion in absolute millimeter coordinates. Feed rate given in millimeters/second
+// unless invert_feed_rate is true. Then the feed_rate means that the motion should be completed in
+// (1 minute)/feed_rate time.
+// NOTE: This is the primary gateway to the grbl planner. All line motions, including arc line
+// segments, must pass through this routine before being passed to the planner. The seperation of
+// mc_line and plan_buffer_line is done primarily to place non-planner-type functions from being
+// in the planner and to let canned cycle integration simple and direct.
+void MC_Line(const float *target, const Planner_LineData_t *pl_data)
+{
+    // If in check gcode mode, prevent motion by blocking planner. Soft limits still work.
+    if(sys.state == STATE_CHECK_MODE)
     {
-        Planner_BufferLine(target_new, &pl_data_new);
+        if(BIT_IS_TRUE(settings.flags, BITFLAG_SOFT_LIMIT_ENABLE))
+        {
+            Limits_SoftCheck(target);
+        }
+
         return;
     }
 
-    // Plan and queue motion into planner buffer
-    if (Planner_BufferLine(target, &pl_data_new) == PLAN_EMPTY_BLOCK)
+    // NOTE: Soft limits are checked by the planner on the target steps of every block.
+
+    // NOTE: Backlash compensation is not handled here. The stepper ISR injects the backlash steps on
+    // direction reversal, so they neither occupy planner slots nor affect junction speeds.
+
+    if(HeightMap_IsActive() && !(pl_data->condition & PL_COND_FLAG_NO_COMPENSATION))
     {
-        if(BIT_IS_TRUE(settings.flags, BITFLAG_LASER_MODE))
-        {
-            // Correctly set spindle state, if there is a coincident position passed. Forces a buffer
-            // sync while in M3 laser mode only.
-            if (pl_data_new.condition & PL_COND_FLAG_SPINDLE_CW)
-            {
-                Spindle_Sync(PL_COND_FLAG_SPINDLE_CW, pl_data_new.spindle_speed);
-            }
-        }
+        MC_HeightMapLine(target, pl_data);
+    }
+    else
+    {
+        MC_BufferLine(target, pl_data);
     }
 }
 
 
 void MC_LineSync(const float *target, const Planner_LineData_t *pl_data, float pitch)
+{
+    float path[1][N_AXIS];
+
+    memcpy(path[0], target, sizeof(path[0]));
+
+    MC_LineSyncPath(path, 1, pl_data, pitch, 0.0);
+}
+
+
+// Executes a chain of spindle synchronized lines, e.g. a thread pass with entry and exit taper.
+// The feed rate of pl_data is the Z-axis feed rate. It is scaled for each line, so that Z always advances
+// by pitch per spindle revolution. The motion starts index_offset revolutions after the encoder index,
+// which is used for multi start threads.
+void MC_LineSyncPath(const float (*path)[N_AXIS], uint8_t count, const Planner_LineData_t *pl_data, float pitch, float index_offset)
 {
     uint8_t old_f_override = sys.f_override;
+    Planner_LineData_t pl_data_line;
+    float position[N_AXIS];
+
+    // Synchronized motion must start from standstill
+    Protocol_BufferSynchronize();
+    System_ConvertArraySteps2Mpos(position, sys_position);
 
     // Put in hold state -  no moves will be started
     sys.state = STATE_HOLD;
 
     sync_pitch = pitch;
 
+#ifndef ENABLE_ELECTRONIC_GEARBOX
     PID_Tune(&pid, 20, 130.0, 0.0);
+#endif
 
     // Disable feed override
     sys.f_override = DEFAULT_FEED_OVERRIDE;
@@ -312,10 +259,37 @@ void MC_LineSync(const float *target, const Planner_LineData_t *pl_data, float p
     // Increase it by a small amount
     s_d += 0.05;
 
+#ifdef ENABLE_ELECTRONIC_GEARBOX
+    // Couple Z-axis to spindle encoder, once accelerated
+    Stepper_GearboxSetup(pitch, s_d);
+#else
     // Calculate position, when feedrate is reached
     pos_z -= (int32_t)(s_d * settings.steps_per_mm[Z_AXIS]);
+#endif
 
-    MC_Line(target, pl_data);
+    memcpy(&pl_data_line, pl_data, sizeof(Planner_LineData_t));
+
+    for(uint8_t i = 0; i < count; i++)
+    {
+        float dist = 0.0;
+        float dist_z = fabsf(path[i][Z_AXIS] - position[Z_AXIS]);
+
+        for(uint8_t idx = 0; idx < N_LINEAR_AXIS; idx++)
+        {
+            dist += (path[i][idx] - position[idx]) * (path[i][idx] - position[idx]);
+        }
+        dist = sqrtf(dist);
+
+        // Keep Z feed constant on tapered lines
+        pl_data_line.feed_rate = pl_data->feed_rate;
+        if(dist_z > 0.0001)
+        {
+            pl_data_line.feed_rate *= dist / dist_z;
+        }
+
+        MC_Line(path[i], &pl_data_line);
+        memcpy(position, path[i], sizeof(position));
+    }
     sys.sync_move = 1;
 
     // Clear
@@ -333,6 +307,23 @@ void MC_LineSync(const float *target, const Planner_LineData_t *pl_data, float p
         }
     }
 
+    if(index_offset > 0.0)
+    {
+        // Wait for start angle
+        uint32_t start = Encoder_GetIndexValue() + (uint32_t)(index_offset * settings.enc_ppr);
+
+        while((int32_t)(Encoder_GetValue() - start) < 0)
+        {
+            Protocol_ExecuteRealtime(); // Check for any run-time commands
+
+            if(sys.abort)
+            {
+                // Bail, if system abort.
+                return;
+            }
+        }
+    }
+
     // Set state back to idle - queued move will be started
     sys.state = STATE_IDLE;
 
@@ -345,7 +336,11 @@ void MC_LineSync(const float *target, const Planner_LineData_t *pl_data, float p
     sys.sync_move = 0;
     start_sync = 0;
     wait_spindle = 0;
+#ifdef ENABLE_ELECTRONIC_GEARBOX
+    Stepper_GearboxStop();
+#else
     Stepper_Ovr(0.0);
+#endif
 
     // Restore old override
     sys.f_override = old_f_override;
@@ -362,8 +357,166 @@ void MC_LineSyncStart(void)
 }
 
 
+#ifdef ENABLE_ELECTRONIC_GEARBOX
+// Stops the spindle and waits until the encoder stands still. Returns false on abort or timeout (alarm).
+static bool MC_RigidTapStopSpindle(void)
+{
+    Spindle_SetState(SPINDLE_DISABLE, 0.0);
+
+    uint32_t start = millis();
+    uint32_t moved = start;
+    uint32_t count = Encoder_GetValue();
+
+    while(1)
+    {
+        Protocol_ExecuteRealtime();
+        if(sys.abort)
+        {
+            return false;
+        }
+
+        uint32_t now = millis();
+        uint32_t value = Encoder_GetValue();
+
+        if(value != count)
+        {
+            count = value;
+            moved = now;
+        }
+        else if((now - moved) >= ENCODER_SPEED_TIMEOUT)
+        {
+            // Stopped
+            return true;
+        }
+
+        if((now - start) >= SPINDLE_AT_SPEED_TIMEOUT)
+        {
+            MC_Reset();
+            System_SetExecAlarm(EXEC_ALARM_RIGID_TAP);
+            return false;
+        }
+    }
+}
+
+
+/* Waits until the tap reached the programmed depth or, when retracting, is back at R. Raises an alarm, if the
+   encoder doesn't count for RIGID_TAP_STALL_TIMEOUT or the stepper ISR stopped the tap at the overshoot limit.
+   Returns false on abort or alarm.
+*/
+static bool MC_RigidTapWait(bool retract)
+{
+    uint32_t moved = millis();
+    uint32_t count = Encoder_GetValue();
+
+    while(retract ? Stepper_TapActive() : !Stepper_TapDepthReached())
+    {
+        Protocol_ExecuteRealtime();
+        if(sys.abort)
+        {
+            return false;
+        }
+
+        uint32_t now = millis();
+        uint32_t value = Encoder_GetValue();
+
+        if(value != count)
+        {
+            count = value;
+            moved = now;
+        }
+
+        if(Stepper_TapFailed() || (now - moved) >= RIGID_TAP_STALL_TIMEOUT)
+        {
+            MC_Reset(); // Stop spindle and motion
+            System_SetExecAlarm(EXEC_ALARM_RIGID_TAP);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+uint8_t MC_RigidTap(float distance, float pitch, uint8_t reverse, float dwell)
+{
+    if(sys.state == STATE_CHECK_MODE)
+    {
+        return STATUS_OK;
+    }
+
+    // Finish all queued motions. Z-axis is at R now.
+    Protocol_BufferSynchronize();
+    if(sys.abort)
+    {
+        return STATUS_OK;
+    }
+
+    // Z-axis follows the spindle, so the spindle speed must not exceed the maximum rate of Z
+    float rpm = gc_state.spindle_speed * (0.010*sys.spindle_speed_ovr);
+
+    if(rpm < 1.0)
+    {
+        return STATUS_IDLE_ERROR;
+    }
+    if(rpm * pitch > settings.max_rate[Z_AXIS])
+    {
+        return STATUS_MAX_STEP_RATE_EXCEEDED;
+    }
+
+    // Z-axis is locked to the spindle at rest, so it accelerates with the spindle
+    if(!MC_RigidTapStopSpindle())
+    {
+        return STATUS_OK;
+    }
+
+    // Slave Z-axis to the spindle encoder. Stepper ISR runs without segments from here on.
+    Stepper_TapStart(pitch, distance, RIGID_TAP_MAX_OVERSHOOT);
+    sys.state = STATE_CYCLE;
+    Stepper_WakeUp();
+
+    Spindle_SetState(gc_state.modal.spindle, gc_state.spindle_speed);
+
+    // Wait till programmed depth is reached
+    if(!MC_RigidTapWait(false))
+    {
+        return STATUS_OK;
+    }
+
+    // Reverse spindle at the bottom. Z-axis follows the spindle while it stops and turns around.
+    if(dwell > 0.0)
+    {
+        Spindle_SetState(SPINDLE_DISABLE, 0.0);
+        Delay_sec(dwell, DELAY_MODE_DWELL);
+        if(sys.abort)
+        {
+            return STATUS_OK;
+        }
+    }
+    Spindle_SetState(reverse, gc_state.spindle_speed);
+    Stepper_TapRetract();
+
+    // Wait till Z-axis is back at R
+    if(!MC_RigidTapWait(true))
+    {
+        return STATUS_OK;
+    }
+
+    // Restore spindle direction
+    Spindle_SetState(gc_state.modal.spindle, gc_state.spindle_speed);
+
+    // Stepper ISR finishes the cycle with the empty segment buffer
+    Protocol_BufferSynchronize();
+    Planner_SyncPosition();
+
+    return STATUS_OK;
+}
+#endif
+
+
 void MC_UpdateSyncMove(void)
 {
+    // NOTE: With the electronic gearbox, synchronisation is done by the stepper ISR.
+#ifndef ENABLE_ELECTRONIC_GEARBOX
     if(sys.sync_move)
     {
         if(start_sync == 0)
@@ -378,31 +531,16 @@ void MC_UpdateSyncMove(void)
 
                 // Save sys position at start
                 pos_z = sys_position[Z_AXIS];
-                // Reset encoder value
-                EncValue = 0;
-                enc_cnt_prev = (uint16_t)Encoder_GetValue();
+                // Save encoder value at start
+                enc_start = Encoder_GetValue();
             }
         }
         else
         {
-            uint16_t cnt = (uint16_t)Encoder_GetValue();
-            uint32_t cnt_diff = 0;
-
-            // Calculate ticks since last event
-            if(cnt < enc_cnt_prev)
-            {
-                // Ovf
-                cnt_diff = (0xFFFF - enc_cnt_prev) + cnt;
-            }
-            else
-            {
-                cnt_diff = cnt - enc_cnt_prev;
-            }
-            enc_cnt_prev = cnt;
-            EncValue += cnt_diff;
+            int32_t enc_diff = (int32_t)(Encoder_GetValue() - enc_start);
 
             // Calculate revolutions since start
-            float rev_actual = (float)EncValue / settings.enc_ppr;
+            float rev_actual = (float)labs(enc_diff) / settings.enc_ppr;
             // Distance since start
             float dist_expected = rev_actual * sync_pitch;
 
@@ -419,6 +557,7 @@ void MC_UpdateSyncMove(void)
             Stepper_Ovr(out);
         }
     }
+#endif
 }
 
 
@@ -650,6 +789,7 @@ uint8_t MC_ProbeCycle(const float *target, const Planner_LineData_t *pl_data, ui
 
     // Finish all queued commands and empty planner buffer before starting probe cycle.
     Protocol_BufferSynchronize();
+    Scan_Stop(); // Probing cycle takes over the probe pin
     if(sys.abort)
     {
         // Return if system reset has been issued.
@@ -663,10 +803,16 @@ uint8_t MC_ProbeCycle(const float *target, const Planner_LineData_t *pl_data, ui
     sys.probe_succeeded = false; // Re-initialize probe history before beginning cycle.
     Probe_ConfigureInvertMask(is_probe_away);
 
+    // Latch probe edges from here on, so no edge is missed between the check below and the motion start.
+    sys_probe_state = PROBE_ACTIVE;
+    Probe_EnableLatch();
+
     // After syncing, check if probe is already triggered. If so, halt and issue alarm.
     // NOTE: This probe initialization error applies to all probing cycles.
-    if(Probe_GetState())   // Check probe pin state.
+    if(Probe_GetState() || sys_probe_state != PROBE_ACTIVE)   // Check probe pin state.
     {
+        sys_probe_state = PROBE_OFF;
+        Probe_DisableLatch();
         System_SetExecAlarm(EXEC_ALARM_PROBE_FAIL_INITIAL);
         Protocol_ExecuteRealtime();
         Probe_ConfigureInvertMask(false); // Re-initialize invert mask before returning.
@@ -675,10 +821,14 @@ uint8_t MC_ProbeCycle(const float *target, const Planner_LineData_t *pl_data, ui
     }
 
     // Setup and queue probing motion. Auto cycle-start should not start the cycle.
-    MC_Line(target, pl_data);
+    // Probe target is where the probe has to stop at the latest, so it isn't height map compensated.
+    Planner_LineData_t pl_probe = *pl_data;
 
-    // Activate the probing state monitor in the stepper module.
-    sys_probe_state = PROBE_ACTIVE;
+    pl_probe.condition |= PL_COND_FLAG_NO_COMPENSATION;
+    MC_Line(target, &pl_probe);
+
+    // Track output steps in the stepper module.
+    Stepper_SelectISR();
 
     // Perform probing cycle. Wait here until probe is triggered or motion completes.
     System_SetExecStateFlag(EXEC_CYCLE_START);
@@ -689,8 +839,15 @@ uint8_t MC_ProbeCycle(const float *target, const Planner_LineData_t *pl_data, ui
         if(sys.abort)
         {
             // Check for system abort
+            Probe_DisableLatch();
             return(GC_PROBE_ABORT);
         }
+
+        if(sys_probe_state == PROBE_OFF && sys.state == STATE_CYCLE && !(sys.suspend & SUSPEND_MOTION_CANCEL))
+        {
+            // Probe triggered before the motion started
+            System_SetExecStateFlag(EXEC_MOTION_CANCEL);
+        }
     } while(sys.state != STATE_IDLE);
 
     // Probing cycle complete!
@@ -713,6 +870,8 @@ uint8_t MC_ProbeCycle(const float *target, const Planner_LineData_t *pl_data, ui
     }
 
     sys_probe_state = PROBE_OFF; // Ensure probe state monitor is disabled.
+    Probe_DisableLatch();
+    Stepper_SelectISR();
     Probe_ConfigureInvertMask(false); // Re-initialize invert mask.
     Protocol_ExecuteRealtime();   // Check and execute run-time commands
 
@@ -720,7 +879,6 @@ uint8_t MC_ProbeCycle(const float *target, const Planner_LineData_t *pl_data, ui
     Stepper_Reset(); // Reset step segment buffer.
     Planner_Reset(); // Reset planner buffer. Zero planner positions. Ensure probing motion is cleared.
     Planner_SyncPosition(); // Sync planner position to current machine position.
-    MC_SyncBacklashPosition();
 
 #ifdef MESSAGE_PROBE_COORDINATES
     // All done! Output the probe position as message.
@@ -770,15 +928,17 @@ void MC_ParkingMotion(const float *parking_target, const Planner_LineData_t *pl_
 
     if(plan_status)
     {
+        Stepper_PrepLock();
         BIT_TRUE(sys.step_control, STEP_CONTROL_EXECUTE_SYS_MOTION);
         BIT_FALSE(sys.step_control, STEP_CONTROL_END_MOTION); // Allow parking motion to execute, if feed hold is active.
         Stepper_ParkingSetupBuffer(); // Setup step segment buffer for special parking motion case
         Stepper_PrepareBuffer();
+        Stepper_PrepUnlock();
         Stepper_WakeUp();
 
         do
         {
-            Protocol_ExecRtSystem();
+            Scheduler_Run();
 
             if(sys.abort)
             {
@@ -787,12 +947,14 @@ void MC_ParkingMotion(const float *parking_target, const Planner_LineData_t *pl_
         }
         while (sys.step_control & STEP_CONTROL_EXECUTE_SYS_MOTION);
 
+        Stepper_PrepLock();
         Stepper_ParkingRestoreBuffer(); // Restore step segment buffer to normal run state.
+        Stepper_PrepUnlock();
     }
     else
     {
         BIT_FALSE(sys.step_control, STEP_CONTROL_EXECUTE_SYS_MOTION);
-        Protocol_ExecRtSystem();
+        Scheduler_Run();
     }
 
 }
@@ -39,7 +39,6 @@
 
 void MC_Init(void);
 
-void MC_SyncBacklashPosition(void);
 
 // Execute linear motion in absolute millimeter coordinates. Feed rate given in millimeters/second
 // unless invert_feed_rate is true. Then the feed_rate means that the motion should be completed in
@@ -48,8 +47,14 @@ void MC_Line(const float *target, const Planner_LineData_t *pl_data);
 
 void MC_LineSync(const float *target, const Planner_LineData_t *pl_data, float pitch);
 
+void MC_LineSyncPath(const float (*path)[N_AXIS], uint8_t count, const Planner_LineData_t *pl_data, float pitch, float index_offset);
+
 void MC_LineSyncStart(void);
 
+// Rigid tapping (G84) from the current position. distance is the signed Z distance to the bottom of the hole.
+// Z-axis is slaved to the spindle encoder on the way in and out. dwell stops the spindle at the bottom (seconds).
+uint8_t MC_RigidTap(float distance, float pitch, uint8_t reverse, float dwell);
+
 void MC_UpdateSyncMove(void);
 
 // Execute an arc in offset mode format. position == current xyz, target == target xyz,
@@ -24,10 +24,15 @@
 
 
 #include <stdint.h>
+#include "Config.h"
 
 
 // EEPROM size in bytes
-#define NVM_SIZE                1024
+#if (USE_EXT_EEPROM)
+    #define NVM_SIZE            1024
+#else
+    #define NVM_SIZE            4096
+#endif
 
 
 void Nvm_Init(void);
@@ -27,6 +27,7 @@
 #include "util.h"
 #include "Settings.h"
 #include "Stepper.h"
+#include "Limits.h"
 #include "Planner.h"
 #include "Print.h"
 
@@ -36,7 +37,7 @@ typedef struct
 {
     int32_t position[N_AXIS];         // The planner position of the tool in absolute steps. Kept separate
     // from g-code position for movements requiring multiple line motions,
-    // i.e. arcs, canned cycles, and backlash compensation.
+    // i.e. arcs and canned cycles.
     float previous_unit_vec[N_AXIS];  // Unit vector of previous path line segment
     float previous_nominal_speed;     // Nominal speed of previous path line segment
 } Planner_t;
@@ -70,10 +71,14 @@ void Planner_Reset(void)
 
 void Planner_ResetBuffer(void)
 {
+    Stepper_PrepLock();
+
     block_buffer_tail = 0;
     block_buffer_head = 0; // Empty = tail
     next_buffer_head = 1; // plan_next_block_index(block_buffer_head)
     block_buffer_planned = 0; // = block_buffer_tail;
+
+    Stepper_PrepUnlock();
 }
 
 
@@ -99,13 +104,17 @@ uint8_t Planner_BufferLine(const float *target, const Planner_LineData_t *pl_dat
     block->condition = pl_data->condition;
     block->spindle_speed = pl_data->spindle_speed;
     block->line_number = pl_data->line_number;
-    block->backlash_motion = pl_data->backlash_motion;
+
+    if(pl_data->spindle_css)
+    {
+        block->spindle_css = 1;
+        block->spindle_limit = pl_data->spindle_limit;
+        block->css_x_end = target[X_AXIS] - pl_data->css_x_offset;
+    }
 
     // Compute and store initial move distance data.
     int32_t target_steps[N_AXIS], position_steps[N_AXIS];
     float unit_vec[N_AXIS], delta_mm;
-    int32_t target_steps_orig[N_AXIS];
-    float unit_vec_orig[N_AXIS], delta_mm_orig;
     uint8_t idx;
 
     // Copy position data based on type of motion being planned.
@@ -161,14 +170,11 @@ uint8_t Planner_BufferLine(const float *target, const Planner_LineData_t *pl_dat
         }
 #else
         target_steps[idx] = lroundf(target[idx]*settings.steps_per_mm[idx]);
-        target_steps_orig[idx] = lroundf((target[idx] + pl_data->backlash[idx]) * settings.steps_per_mm[idx]);
         block->steps[idx] = labs(target_steps[idx]-position_steps[idx]);
         block->step_event_count = max(block->step_event_count, block->steps[idx]);
         delta_mm = (target_steps[idx] - position_steps[idx])/settings.steps_per_mm[idx];
-        delta_mm_orig = (target_steps_orig[idx] - position_steps[idx]) / settings.steps_per_mm[idx];
 #endif
         unit_vec[idx] = delta_mm; // Store unit vector numerator
-        unit_vec_orig[idx] = delta_mm_orig;
 
         // Set direction bits. Bit enabled always means direction is negative.
         if(delta_mm < 0.0)
@@ -177,6 +183,15 @@ uint8_t Planner_BufferLine(const float *target, const Planner_LineData_t *pl_dat
         }
     }
 
+    // Check soft limits on the integer target. Jog targets are checked before and homing/parking motions ignore soft limits.
+    if(BIT_IS_TRUE(settings.flags, BITFLAG_SOFT_LIMIT_ENABLE) && !(block->condition & PL_COND_FLAG_SYSTEM_MOTION) && sys.state != STATE_JOG)
+    {
+        if(Limits_SoftCheckSteps(target_steps))
+        {
+            return PLAN_SOFT_LIMIT;
+        }
+    }
+
     // Bail if this is a zero-length block. Highly unlikely to occur.
     if(block->step_event_count == 0)
     {
@@ -188,6 +203,7 @@ uint8_t Planner_BufferLine(const float *target, const Planner_LineData_t *pl_dat
     // NOTE: This calculation assumes all axes are orthogonal (Cartesian) and works with ABC-axes,
     // if they are also orthogonal/independent. Operates on the absolute value of the unit vector.
     block->millimeters = convert_delta_vector_to_unit_vector(unit_vec);
+    block->css_x_dir = unit_vec[X_AXIS];
     block->acceleration = limit_value_by_axis_maximum(settings.acceleration, unit_vec);
     block->rapid_rate = limit_value_by_axis_maximum(settings.max_rate, unit_vec);
 
@@ -205,6 +221,30 @@ uint8_t Planner_BufferLine(const float *target, const Planner_LineData_t *pl_dat
         }
     }
 
+#ifdef PLANNER_SLOWDOWN
+    // Stretch short blocks while the buffer is draining. When the host can't keep up, the planner
+    // would otherwise decelerate to a stop at the end of every block. Running slower but
+    // continuously gives the stream time to refill the buffer.
+    // NOTE: Jog, parking and spindle synchronized motions are never slowed down.
+    if(!(block->condition & (PL_COND_FLAG_SYSTEM_MOTION | PL_COND_FLAG_NO_FEED_OVERRIDE)) && !sys.sync_move)
+    {
+        uint8_t blocks_queued = (BLOCK_BUFFER_SIZE-1) - Planner_GetBlockBufferAvailable();
+
+        if((blocks_queued > 1) && (blocks_queued < PLANNER_SLOWDOWN_WATERMARK))
+        {
+            float block_time = block->millimeters / block->programmed_rate; // (min)
+            const float min_block_time = PLANNER_MIN_SEGMENT_TIME / (60.0 * 1000000.0); // (min)
+
+            if(block_time < min_block_time)
+            {
+                // Emptier buffer, stronger slowdown.
+                block_time += 2.0 * (min_block_time - block_time) / blocks_queued;
+                block->programmed_rate = block->millimeters / block_time;
+            }
+        }
+    }
+#endif
+
     // TODO: Need to check this method handling zero junction speeds when starting from rest.
     if((block_buffer_head == block_buffer_tail) || (block->condition & PL_COND_FLAG_SYSTEM_MOTION))
     {
@@ -277,19 +317,12 @@ uint8_t Planner_BufferLine(const float *target, const Planner_LineData_t *pl_dat
         Planner_ComputeProfileParams(block, nominal_speed, planner.previous_nominal_speed);
         planner.previous_nominal_speed = nominal_speed;
 
-        if(block->backlash_motion == 0)
-        {
-            // Update previous path unit_vector and planner position.
-            memcpy(planner.previous_unit_vec, unit_vec, sizeof(unit_vec));  // pl.previous_unit_vec[] = unit_vec[]
-            memcpy(planner.position, target_steps, sizeof(target_steps));   // pl.position[] = target_steps[]
-        }
-        else
-        {
-            // Block contains backlash compensation data, which must be excluded from planner
-            // Update previous path unit_vector and planner position.
-            memcpy(planner.previous_unit_vec, unit_vec_orig, sizeof(unit_vec_orig));
-            memcpy(planner.position, target_steps_orig, sizeof(target_steps_orig));
-        }
+        // Update previous path unit_vector and planner position.
+        memcpy(planner.previous_unit_vec, unit_vec, sizeof(unit_vec));  // pl.previous_unit_vec[] = unit_vec[]
+        memcpy(planner.position, target_steps, sizeof(target_steps));   // pl.position[] = target_steps[]
+
+        // Segment prep may run from interrupt. Keep it out while the buffer is replanned.
+        Stepper_PrepLock();
 
         // New block is all set. Update buffer head and next buffer head indices.
         block_buffer_head = next_buffer_head;
@@ -297,6 +330,8 @@ uint8_t Planner_BufferLine(const float *target, const Planner_LineData_t *pl_dat
 
         // Finish up by recalculating the plan with the new block.
         Planner_Recalculate();
+
+        Stepper_PrepUnlock();
     }
 
     return PLAN_OK;
@@ -403,6 +438,8 @@ void Planner_UpdateVelocityProfileParams(void)
     float nominal_speed;
     float prev_nominal_speed = SOME_LARGE_VALUE; // Set high for first block nominal speed calculation.
 
+    Stepper_PrepLock();
+
     while(block_index != block_buffer_head)
     {
         block = &block_buffer[block_index];
@@ -412,6 +449,8 @@ void Planner_UpdateVelocityProfileParams(void)
         block_index = Planner_NextBlockIndex(block_index);
     }
 
+    Stepper_PrepUnlock();
+
     planner.previous_nominal_speed = prev_nominal_speed; // Update prev nominal speed for next incoming block.
 }
 
@@ -443,14 +482,28 @@ void Planner_SyncPosition(void)
 }
 
 
+// Returns the planner position (target of the last planned block) in mm
+void Planner_GetPosition(float *position)
+{
+    for (uint8_t idx = 0; idx < N_AXIS; idx++)
+    {
+        position[idx] = planner.position[idx] / settings.steps_per_mm[idx];
+    }
+}
+
+
 // Re-initialize buffer plan with a partially completed block, assumed to exist at the buffer tail.
 // Called after a steppers have come to a complete stop for a feed hold and the cycle is stopped.
 void Planner_CycleReinitialize(void)
 {
+    Stepper_PrepLock();
+
     // Re-plan from a complete stop. Reset planner entry speeds and buffer planned pointer.
     Stepper_UpdatePlannerBlockParams();
     block_buffer_planned = block_buffer_tail;
     Planner_Recalculate();
+
+    Stepper_PrepUnlock();
 }
 
 
@@ -29,6 +29,7 @@
 // Returned status message from planner.
 #define PLAN_OK                             true
 #define PLAN_EMPTY_BLOCK                    false
+#define PLAN_SOFT_LIMIT                     2  // Target outside of soft limits. Block not planned.
 
 // Define planner data condition flags. Used to denote running conditions of a block.
 #define PL_COND_FLAG_RAPID_MOTION           BIT(0)
@@ -39,6 +40,7 @@
 #define PL_COND_FLAG_SPINDLE_CCW            BIT(5)
 #define PL_COND_FLAG_COOLANT_FLOOD          BIT(6)
 #define PL_COND_FLAG_COOLANT_MIST           BIT(7)
+#define PL_COND_FLAG_NO_COMPENSATION        BIT(8) // Motion bypasses height map compensation. Used by probing/jog.
 #define PL_COND_MOTION_MASK                 (PL_COND_FLAG_RAPID_MOTION|PL_COND_FLAG_SYSTEM_MOTION|PL_COND_FLAG_NO_FEED_OVERRIDE)
 #define PL_COND_SPINDLE_MASK                (PL_COND_FLAG_SPINDLE_CW|PL_COND_FLAG_SPINDLE_CCW)
 #define PL_COND_ACCESSORY_MASK              (PL_COND_FLAG_SPINDLE_CW|PL_COND_FLAG_SPINDLE_CCW|PL_COND_FLAG_COOLANT_FLOOD|PL_COND_FLAG_COOLANT_MIST)
@@ -55,7 +57,7 @@ typedef struct
     uint8_t direction_bits;    // The direction bit set for this block (refers to *_DIRECTION_BIT in config.h)
 
     // Block condition data to ensure correct execution depending on states and overrides.
-    uint8_t condition;      // Block bitflag variable defining block run conditions. Copied from pl_line_data.
+    uint16_t condition;     // Block bitflag variable defining block run conditions. Copied from pl_line_data.
     int32_t line_number;  // Block line number for real-time reporting. Copied from pl_line_data.
 
     // Fields used by the motion planner to manage acceleration. Some of these values may be updated
@@ -75,7 +77,11 @@ typedef struct
     // Stored spindle speed data used by spindle overrides and resuming methods.
     float spindle_speed;    // Block spindle speed. Copied from pl_line_data.
 
-    uint8_t backlash_motion;
+    // Constant surface speed (G96). spindle_speed is the surface speed (m/min).
+    uint8_t spindle_css;
+    float spindle_limit;    // Max RPM
+    float css_x_end;        // X position at end of block in work coordinates (mm)
+    float css_x_dir;        // X component of unit vector
 } Planner_Block_t;
 
 
@@ -84,11 +90,11 @@ typedef struct
 {
     float feed_rate;          // Desired feed rate for line motion. Value is ignored, if rapid motion.
     float spindle_speed;      // Desired spindle speed through line motion.
-    uint8_t condition;        // Bitflag variable to indicate planner conditions. See defines above.
+    uint16_t condition;       // Bitflag variable to indicate planner conditions. See defines above.
     int32_t line_number;      // Desired line number to report when executing.
-
-    uint8_t backlash_motion;
-    float backlash[N_AXIS];
+    uint8_t spindle_css;      // Constant surface speed (G96). spindle_speed is the surface speed.
+    float spindle_limit;      // Max RPM in G96
+    float css_x_offset;       // Work coordinate offset of X axis
 } Planner_LineData_t;
 
 
@@ -127,6 +133,9 @@ void Planner_UpdateVelocityProfileParams(void);
 // Reset the planner position vector (in steps)
 void Planner_SyncPosition(void);
 
+// Get the planner position vector (in mm)
+void Planner_GetPosition(float *position);
+
 // Reinitialize plan with a partially completed block
 void Planner_CycleReinitialize(void);
 
@@ -23,10 +23,15 @@
 #include "Settings.h"
 #include "System.h"
 #include "GPIO.h"
+#include "EXTI.h"
+#include "Stepper.h"
+#include "ProbeScan.h"
 
 
 // Inverts the probe pin state depending on user settings and probing cycle mode.
 static uint8_t probe_invert_mask;
+// Probe pin is connected to EXTI line 0
+static volatile uint8_t latch_enabled = 0;
 
 
 // Probe pin initialization routine.
@@ -35,6 +40,7 @@ void Probe_Init(void)
     GPIO_InitGPIO(GPIO_PROBE);
 
     Probe_ConfigureInvertMask(false); // Initialize invert mask.*/
+    Probe_DisableLatch();
 }
 
 
@@ -70,15 +76,50 @@ uint8_t Probe_GetState(void)
 }
 
 
-// Monitors probe pin state and records the system position when detected. Called by the
-// stepper ISR per ISR tick.
-// NOTE: This function must be extremely efficient as to not bog down the stepper ISR.
-void Probe_StateMonitor(void)
+// The probe pin (PC0) shares EXTI line 0 with the reset pin (PA0). During a probing cycle the line
+// is connected to the probe and the reset pin is polled instead.
+void Probe_EnableLatch(void)
 {
-    if(Probe_GetState())
+    Exti_ConfigLine(EXTI_PortSourceGPIOC, EXTI_PinSource0);
+    latch_enabled = 1;
+}
+
+
+void Probe_DisableLatch(void)
+{
+    latch_enabled = 0;
+    Exti_ConfigLine(EXTI_PortSourceGPIOA, EXTI_PinSource0);
+}
+
+
+uint8_t Probe_LatchEnabled(void)
+{
+    return latch_enabled;
+}
+
+
+// Probe pin edge. Records the machine position at the time of the edge, which is exact to the step
+// already output. A motion in progress is cancelled, otherwise the probing cycle cancels it once
+// the motion started.
+void Probe_EdgeISR(void)
+{
+    if(Scan_IsActive())
     {
+        Scan_ProbeEdgeISR(Probe_GetState());
+        return;
+    }
+
+    if(sys_probe_state == PROBE_ACTIVE && Probe_GetState())
+    {
+        // Keep stepper ISR from changing the position meanwhile
+        __disable_irq();
+        Stepper_GetOutputPosition(sys_probe_position);
         sys_probe_state = PROBE_OFF;
-        memcpy(sys_probe_position, sys_position, sizeof(sys_position));
-        BIT_TRUE(sys_rt_exec_state, EXEC_MOTION_CANCEL);
+        __enable_irq();
+
+        if(sys.state & STATE_CYCLE)
+        {
+            BIT_TRUE(sys_rt_exec_state, EXEC_MOTION_CANCEL);
+        }
     }
 }
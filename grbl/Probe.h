@@ -38,12 +38,16 @@ void Probe_Reset(void);
 // and the probing cycle modes for toward-workpiece/away-from-workpiece.
 void Probe_ConfigureInvertMask(uint8_t is_probe_away);
 
-// Returns probe pin state. Triggered = true. Called by gcode parser and probe state monitor.
+// Returns probe pin state. Triggered = true. Called by gcode parser and probe interrupt.
 uint8_t Probe_GetState(void);
 
-// Monitors probe pin state and records the system position when detected. Called by the
-// stepper ISR per ISR tick.
-void Probe_StateMonitor(void);
+// Connects probe pin to EXTI line 0 during a probing cycle. Reset pin uses it otherwise.
+void Probe_EnableLatch(void);
+void Probe_DisableLatch(void);
+uint8_t Probe_LatchEnabled(void);
+
+// Probe pin interrupt. Latches the machine position, when the probe triggers.
+void Probe_EdgeISR(void);
 
 
 #endif // PROBE_H
@@ -0,0 +1,224 @@
+/*
+  ProbeScan.c - Scanning probe digitising mode
+  Part of Grbl-Advanced
+
+  Copyright (c) 2021 Patrick F.
+
+  Grbl-Advanced is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl-Advanced is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl-Advanced.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include <math.h>
+#include "Config.h"
+#include "ProbeScan.h"
+#include "Probe.h"
+#include "Settings.h"
+#include "Stepper.h"
+#include "System.h"
+#include "CRC.h"
+#include "Print.h"
+#include "System32.h"
+
+
+#pragma pack(push, 1)
+typedef struct
+{
+    int32_t position[N_AXIS];   // Machine position (steps)
+    uint8_t flags;
+} ScanPoint_t;
+#pragma pack(pop)
+
+
+static ScanPoint_t scan_buffer[SCAN_BUFFER_SIZE];
+static volatile uint16_t scan_head = 0;
+static volatile uint16_t scan_tail = 0;
+
+static volatile uint8_t scan_active = 0;
+static volatile uint8_t scan_overflow = 0;
+static uint8_t scan_probe_state = 0;
+static uint8_t scan_sequence = 0;
+
+// Fixed distance samples (mm). Zero records probe state changes only.
+static float sample_distance = 0.0;
+static int32_t last_sample[N_AXIS];
+
+
+// Stores a point at the current machine position. Interrupts are disabled, because the probe
+// interrupt and the system tick both record points.
+static void Scan_Record(uint8_t flags)
+{
+    __disable_irq();
+
+    uint16_t next = scan_head + 1;
+
+    if(next == SCAN_BUFFER_SIZE)
+    {
+        next = 0;
+    }
+
+    if(next == scan_tail)
+    {
+        // Buffer full. Host is told with the next stored point.
+        scan_overflow = 1;
+    }
+    else
+    {
+        ScanPoint_t *point = &scan_buffer[scan_head];
+
+        Stepper_GetOutputPosition(point->position);
+        point->flags = flags | scan_probe_state | (scan_overflow ? SCAN_FLAG_OVERFLOW : 0);
+
+        if(flags & SCAN_FLAG_SAMPLE)
+        {
+            memcpy(last_sample, point->position, sizeof(last_sample));
+        }
+
+        scan_overflow = 0;
+        scan_head = next;
+    }
+
+    __enable_irq();
+}
+
+
+void Scan_Init(void)
+{
+    scan_active = 0;
+    scan_overflow = 0;
+    scan_head = 0;
+    scan_tail = 0;
+}
+
+
+void Scan_Start(float distance)
+{
+    sample_distance = distance;
+
+    Probe_ConfigureInvertMask(false);
+    scan_probe_state = Probe_GetState() ? SCAN_FLAG_TRIGGERED : 0;
+
+    memcpy(last_sample, sys_position, sizeof(last_sample));
+    scan_overflow = 0;
+    scan_active = 1;
+
+    Probe_EnableLatch();
+    Stepper_SelectISR();
+
+    // Starting point
+    Scan_Record(SCAN_FLAG_SAMPLE);
+}
+
+
+// Recorded points, which are not sent yet, are still streamed.
+void Scan_Stop(void)
+{
+    if(!scan_active)
+    {
+        return;
+    }
+
+    scan_active = 0;
+
+    Probe_DisableLatch();
+    Stepper_SelectISR();
+}
+
+
+bool Scan_IsActive(void)
+{
+    return scan_active;
+}
+
+
+// Probe pin edge while scanning. Bouncing is recorded as well, the host sees every state change.
+void Scan_ProbeEdgeISR(uint8_t triggered)
+{
+    uint8_t state = triggered ? SCAN_FLAG_TRIGGERED : 0;
+
+    if(!scan_active || state == scan_probe_state)
+    {
+        return;
+    }
+
+    scan_probe_state = state;
+    Scan_Record(SCAN_FLAG_EDGE);
+}
+
+
+// Records a sample, once the machine moved sample_distance from the last one. Called every
+// millisecond by the system tick, so samples are up to one millisecond of travel apart from the ideal spacing.
+void Scan_SampleISR(void)
+{
+    if(!scan_active || sample_distance <= 0.0)
+    {
+        return;
+    }
+
+    float dist = 0.0;
+
+    for(uint8_t idx = 0; idx < N_LINEAR_AXIS; idx++)
+    {
+        float delta = (sys_position[idx] - last_sample[idx]) / settings.steps_per_mm[idx];
+
+        dist += delta*delta;
+    }
+
+    if(dist >= sample_distance*sample_distance)
+    {
+        Scan_Record(SCAN_FLAG_SAMPLE);
+    }
+}
+
+
+/* Streams recorded points as binary frames, without blocking motion. Frame layout (little endian):
+   0xA5, N_AXIS, sequence number, point count, points, CRC8 over everything after 0xA5.
+   Each point is int32 machine position per axis (steps) followed by a flags byte (SCAN_FLAG_*).
+   The host converts steps with the $100 settings. Runs as scheduler task.
+*/
+void Scan_Task(void)
+{
+    static uint8_t frame[4 + SCAN_FRAME_POINTS*sizeof(ScanPoint_t) + 1];
+
+    uint16_t tail = scan_tail;
+    uint8_t count = 0;
+    uint16_t len = 4;
+
+    while(tail != scan_head && count < SCAN_FRAME_POINTS)
+    {
+        memcpy(&frame[len], &scan_buffer[tail], sizeof(ScanPoint_t));
+        len += sizeof(ScanPoint_t);
+        count++;
+
+        if(++tail == SCAN_BUFFER_SIZE)
+        {
+            tail = 0;
+        }
+    }
+
+    if(count == 0)
+    {
+        return;
+    }
+
+    frame[0] = SCAN_FRAME_START;
+    frame[1] = N_AXIS;
+    frame[2] = scan_sequence++;
+    frame[3] = count;
+    frame[len] = CRC_CalculateCRC8(&frame[1], len-1);
+    len++;
+
+    Printf_Binary(frame, len);
+
+    // Free the points, once they are sent
+    scan_tail = tail;
+}
@@ -0,0 +1,56 @@
+/*
+  ProbeScan.h - Scanning probe digitising mode
+  Part of Grbl-Advanced
+
+  Copyright (c) 2021 Patrick F.
+
+  Grbl-Advanced is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl-Advanced is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl-Advanced.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef PROBESCAN_H
+#define PROBESCAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "util.h"
+
+
+#define SCAN_FRAME_START            0xA5
+
+// Point flags
+#define SCAN_FLAG_TRIGGERED         BIT(0)  // Probe state at this point
+#define SCAN_FLAG_EDGE              BIT(1)  // Recorded on probe state change
+#define SCAN_FLAG_SAMPLE            BIT(2)  // Recorded after sample distance
+#define SCAN_FLAG_OVERFLOW          BIT(3)  // Points were lost before this one
+
+
+// Stops scanning and clears the point buffer
+void Scan_Init(void);
+
+// Starts recording probe state changes and, if distance > 0, samples every distance (mm) of travel.
+// Following motions are executed normally.
+void Scan_Start(float distance);
+void Scan_Stop(void);
+bool Scan_IsActive(void);
+
+// Called by probe interrupt while scanning
+void Scan_ProbeEdgeISR(uint8_t triggered);
+
+// Called by system tick
+void Scan_SampleISR(void);
+
+// Streams recorded points to the host. Runs as scheduler task.
+void Scan_Task(void);
+
+
+#endif // PROBESCAN_H
@@ -30,6 +30,10 @@
 #include "CoolantControl.h"
 #include "Protocol.h"
 #include "MotionControl.h"
+#include "Scheduler.h"
+#include "ProbeScan.h"
+#include "SpindleVFD.h"
+#include "Recovery.h"
 
 #include "GrIP.h"
 #include "Platform.h"
@@ -58,8 +62,35 @@
 
 static char line[LINE_BUFFER_SIZE] = {}; // Line to be executed. Zero-terminated.
 static void Protocol_ExecRtSuspend(void);
+static void Protocol_CommTask(void);
+static void Protocol_EthernetTask(void);
+static void Protocol_ReportTask(void);
 extern void ProcessReceive(char c);
 
+
+// Registers the realtime tasks with the scheduler. Task ID is the priority.
+void Protocol_Init(void)
+{
+    Scheduler_Init();
+
+    Scheduler_AddTask(TASK_REALTIME, "RT", Protocol_ExecRtSystem, 0, TASK_BUDGET_REALTIME);
+#if (USE_ETH_IF)
+    Scheduler_AddTask(TASK_COMM, "COM", Protocol_CommTask, 0, TASK_BUDGET_COMM);
+    Scheduler_AddTask(TASK_ETHERNET, "ETH", Protocol_EthernetTask, TASK_PERIOD_ETHERNET, TASK_BUDGET_ETHERNET);
+#else
+    (void)Protocol_CommTask;
+    (void)Protocol_EthernetTask;
+#endif
+#ifdef ENABLE_VFD_MODBUS
+    Scheduler_AddTask(TASK_VFD, "VFD", VFD_Task, 0, TASK_BUDGET_VFD);
+#endif
+    Scheduler_AddTask(TASK_SCAN, "SCN", Scan_Task, 0, TASK_BUDGET_SCAN);
+    Scheduler_AddTask(TASK_REPORT, "RPT", Protocol_ReportTask, 0, TASK_BUDGET_REPORT);
+#ifdef ENABLE_RECOVERY
+    Scheduler_AddTask(TASK_RECOVERY, "REC", Recovery_Task, TASK_PERIOD_RECOVERY, TASK_BUDGET_RECOVERY);
+#endif
+}
+
 /*
   GRBL PRIMARY LOOP:
 */
@@ -83,6 +114,13 @@ void Protocol_MainLoop(void)
         Report_FeedbackMessage(MESSAGE_CHECK_INPUTS);
     }
 
+#ifdef ENABLE_RECOVERY
+    if(Recovery_PositionAvailable())
+    {
+        Report_FeedbackMessage(MESSAGE_POSITION_RECOVERY);
+    }
+#endif
+
     // Check for and report alarm state after a reset, error, or an initial power up.
     // NOTE: Sleep mode disables the stepper drivers and position can't be guaranteed.
     // Re-initialize the sleep state as an ALARM mode to ensure user homes or acknowledges.
@@ -159,6 +197,10 @@ void Protocol_MainLoop(void)
                 }
                 else
                 {
+#ifdef ENABLE_RECOVERY
+                    // Ends the job recovery fast-forward at the resume line
+                    Recovery_CheckLine(line);
+#endif
                     // Parse and execute g-code block.
                     Report_StatusMessage(GC_ExecuteLine(line));
                 }
@@ -296,12 +338,20 @@ void Protocol_AutoCycleStart(void)
 // limit switches, or the main program.
 void Protocol_ExecuteRealtime(void)
 {
-    RX_Packet_t packet;
+    Scheduler_Run();
+
+    if(sys.suspend)
+    {
+        Protocol_ExecRtSuspend();
+    }
+}
 
-    Protocol_ExecRtSystem();
 
+// Receives GrIP packets and passes them to the realtime command parser.
+static void Protocol_CommTask(void)
+{
 #if (USE_ETH_IF)
-    ServerTCP_Update();
+    RX_Packet_t packet;
 
     GrIP_Update();
 
@@ -312,13 +362,26 @@ void Protocol_ExecuteRealtime(void)
             ProcessReceive(packet.Data[i]);
         }
     }
-#else
-    (void)packet;
 #endif
+}
 
-    if(sys.suspend)
+
+static void Protocol_EthernetTask(void)
+{
+#if (USE_ETH_IF)
+    ServerTCP_Update();
+#endif
+}
+
+
+// Prints the realtime status report, if requested. Runs at lowest priority, so a slow
+// serial link can't delay the state machine or segment prep.
+static void Protocol_ReportTask(void)
+{
+    if(sys_rt_exec_state & EXEC_STATUS_REPORT)
     {
-        Protocol_ExecRtSuspend();
+        Report_RealtimeStatus();
+        System_ClearExecStateFlag(EXEC_STATUS_REPORT);
     }
 }
 
@@ -370,12 +433,20 @@ void Protocol_ExecRtSystem(void)
             return; // Nothing else to do but exit.
         }
 
-        // Execute and serial print status
-        if(rt_exec & EXEC_STATUS_REPORT)
+        // NOTE: Status reports are printed by the report task.
+
+        // State changes below modify the planner buffer and step control. Hold off the segment
+        // refill interrupt until the final buffer reload.
+        Stepper_PrepLock();
+
+#ifdef ENABLE_ELECTRONIC_GEARBOX
+        if(Stepper_TapActive())
         {
-            Report_RealtimeStatus();
-            System_ClearExecStateFlag(EXEC_STATUS_REPORT);
+            // A rigid tap runs outside the segment buffer and can't decelerate for a hold. The hold events stay
+            // pending until the tap is back at R.
+            rt_exec &= ~(EXEC_MOTION_CANCEL | EXEC_FEED_HOLD | EXEC_SAFETY_DOOR | EXEC_SLEEP);
         }
+#endif
 
         // NOTE: Once hold is initiated, the system immediately enters a suspend state to block all
         // main program processes until either reset or resumed. This ensures a hold completes safely.
@@ -571,7 +642,6 @@ void Protocol_ExecRtSystem(void)
                     Stepper_Reset();
                     GC_SyncPosition();
                     Planner_SyncPosition();
-                    MC_SyncBacklashPosition();
                 }
 
                 if(sys.suspend & SUSPEND_SAFETY_DOOR_AJAR)   // Only occurs when safety door opens during jog.
@@ -590,6 +660,11 @@ void Protocol_ExecRtSystem(void)
         }
     }
 
+    else
+    {
+        Stepper_PrepLock();
+    }
+
     // Execute overrides.
     rt_exec = sys_rt_exec_motion_override; // Copy volatile sys_rt_exec_motion_override
     if(rt_exec && !sys.sync_move)
@@ -777,6 +852,8 @@ void Protocol_ExecRtSystem(void)
     {
         Stepper_PrepareBuffer();
     }
+
+    Stepper_PrepUnlock();
 }
 
 
@@ -802,7 +879,6 @@ static void Protocol_ExecRtSuspend(void)
 
     Planner_Block_t *block = Planner_GetCurrentBlock();
     uint8_t restore_condition;
-    RX_Packet_t packet;
 
     float restore_spindle_speed;
     if(block == 0)
@@ -829,21 +905,6 @@ static void Protocol_ExecRtSuspend(void)
             return;
         }
 
-#if (USE_ETH_IF)
-        GrIP_Update();
-
-        if(GrIP_Receive(&packet))
-        {
-            for(int i = 0; i < packet.RX_Header.Length; i++)
-            {
-                ProcessReceive(packet.Data[i]);
-            }
-        }
-        ServerTCP_Update();
-#else
-        (void)packet;
-#endif
-
         // Block until initial hold is complete and the machine has stopped motion.
         if(sys.suspend & SUSPEND_HOLD_COMPLETE)
         {
@@ -941,7 +1002,7 @@ static void Protocol_ExecRtSuspend(void)
                         while(!(sys.abort))
                         {
                             // Do nothing until reset.
-                            Protocol_ExecRtSystem();
+                            Scheduler_Run();
                         }
                         // Abort received. Return to re-initialize.
                         return;
@@ -997,7 +1058,7 @@ static void Protocol_ExecRtSuspend(void)
                                 else
                                 {
                                     Spindle_SetState((restore_condition & (PL_COND_FLAG_SPINDLE_CW | PL_COND_FLAG_SPINDLE_CCW)), restore_spindle_speed);
-                                    Delay_sec(SAFETY_DOOR_SPINDLE_DELAY, DELAY_MODE_SYS_SUSPEND);
+                                    Spindle_WaitAtSpeed(SAFETY_DOOR_SPINDLE_DELAY, DELAY_MODE_SYS_SUSPEND);
                                 }
                             }
                         }
@@ -1104,6 +1165,6 @@ static void Protocol_ExecRtSuspend(void)
             }
         }
 
-        Protocol_ExecRtSystem();
+        Scheduler_Run();
     }
 }
@@ -23,6 +23,9 @@
 #define PROTOCOL_H
 
 
+// Registers the realtime tasks with the scheduler.
+void Protocol_Init(void);
+
 // Starts Grbl main loop. It handles all incoming characters from the serial port and executes
 // them as they complete. It is also responsible for finishing the initialization procedures.
 void Protocol_MainLoop(void);
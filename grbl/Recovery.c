@@ -0,0 +1,386 @@
+/*
+  Recovery.c - Machine position backup in battery backed memory
+  Part of Grbl-Advanced
+
+  Copyright (c) 2021 Patrick F.
+
+  Grbl-Advanced is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl-Advanced is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl-Advanced.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stddef.h>
+#include <string.h>
+#include "Recovery.h"
+#include "BackupRam.h"
+#include "CRC.h"
+#include "Config.h"
+#include "CoolantControl.h"
+#include "GCode.h"
+#include "MotionControl.h"
+#include "Planner.h"
+#include "Report.h"
+#include "Settings.h"
+#include "SpindleControl.h"
+#include "Stepper.h"
+#include "System.h"
+#include "util.h"
+
+
+#define RECOVERY_MAGIC              0xA5
+
+
+typedef struct
+{
+    int32_t position[N_AXIS];   // Machine position (steps)
+    uint8_t magic;
+    uint8_t homed;
+    uint8_t coord_select;
+} Recovery_Position_t;
+
+
+// Each record is followed by its CRC8
+#define RECOVERY_ADDR_POSITION      0U
+#define RECOVERY_ADDR_CHECKPOINT    (RECOVERY_ADDR_POSITION + sizeof(Recovery_Position_t) + 1)
+#define RECOVERY_SIZE               (RECOVERY_ADDR_CHECKPOINT + sizeof(Recovery_Checkpoint_t) + 1)
+
+// Both records must fit into the backup registers of the F411
+_Static_assert(RECOVERY_SIZE <= BACKUP_REG_SIZE, "Recovery records exceed the backup registers");
+
+
+static Recovery_Position_t backup;      // Content of the backup memory
+static bool backup_valid = false;
+
+static Recovery_Position_t restored;    // Backup found at power-up
+static bool restore_pending = false;
+
+static Recovery_Checkpoint_t checkpoint;
+static bool checkpoint_valid = false;
+
+static int32_t resume_line = 0;
+static bool fast_forward = false;
+
+
+// Returns false, if the record doesn't fit into the backup memory
+static bool Recovery_Write(uint16_t addr, const void *data, uint16_t size)
+{
+    uint8_t crc = CRC_CalculateCRC8((const uint8_t*)data, size);
+
+    if(!BackupRam_Write(addr, (const uint8_t*)data, size))
+    {
+        return false;
+    }
+
+    return BackupRam_Write(addr + size, &crc, 1);
+}
+
+
+// Returns false, if the CRC does not match
+static bool Recovery_Read(uint16_t addr, void *data, uint16_t size)
+{
+    uint8_t crc = 0;
+
+    BackupRam_Read(addr, (uint8_t*)data, size);
+    BackupRam_Read(addr + size, &crc, 1);
+
+    return crc == CRC_CalculateCRC8((const uint8_t*)data, size);
+}
+
+
+void Recovery_Init(void)
+{
+    BackupRam_Init();
+
+    if(Recovery_Read(RECOVERY_ADDR_POSITION, &restored, sizeof(Recovery_Position_t)) && restored.magic == RECOVERY_MAGIC)
+    {
+        // Keep the backup until the machine moves, so it survives another power cycle
+        memcpy(&backup, &restored, sizeof(Recovery_Position_t));
+        backup_valid = true;
+        restore_pending = true;
+    }
+
+    if(Recovery_Read(RECOVERY_ADDR_CHECKPOINT, &checkpoint, sizeof(Recovery_Checkpoint_t)) && checkpoint.magic == RECOVERY_MAGIC)
+    {
+        checkpoint_valid = true;
+    }
+}
+
+
+/* A backup is only valid while the machine stands still. Position is saved in IDLE and invalidated as soon as
+   the steppers start. With disabled drivers in idle ($1 != 255 or stepper disable command), the axes may be moved
+   by hand, so nothing is saved.
+   The backup found at power-up is kept until it is either restored or the machine moves.
+*/
+static void Recovery_UpdatePosition(void)
+{
+    if(sys.state == STATE_IDLE)
+    {
+        if(restore_pending)
+        {
+            return;
+        }
+        if(!Stepper_DriversEnabled())
+        {
+            Recovery_Invalidate();
+            return;
+        }
+
+        Recovery_Position_t current;
+
+        memset(&current, 0, sizeof(Recovery_Position_t));
+        memcpy(current.position, sys_position, sizeof(sys_position));
+        current.magic = RECOVERY_MAGIC;
+        current.homed = sys.is_homed;
+        current.coord_select = gc_state.modal.coord_select;
+
+        if(!backup_valid || memcmp(&current, &backup, sizeof(Recovery_Position_t)) != 0)
+        {
+            memcpy(&backup, &current, sizeof(Recovery_Position_t));
+            backup_valid = Recovery_Write(RECOVERY_ADDR_POSITION, &backup, sizeof(Recovery_Position_t));
+        }
+    }
+    else if(sys.state != STATE_ALARM && sys.state != STATE_CHECK_MODE)
+    {
+        // Sleep, door or any motion
+        Recovery_Invalidate();
+    }
+}
+
+
+/* Writes a checkpoint, whenever the stepper starts executing a block with a new line number. The task period
+   bounds the write rate. Spindle, coolant, feed and speed are taken from the executing block, the remaining
+   modal state from the parser, which may already be a few lines ahead.
+*/
+static void Recovery_UpdateCheckpoint(void)
+{
+    if(!(sys.state & (STATE_CYCLE | STATE_HOLD)))
+    {
+        return;
+    }
+
+    Planner_Block_t *block = Planner_GetCurrentBlock();
+
+    if(block == 0 || block->line_number <= 0)
+    {
+        return;
+    }
+    if(checkpoint_valid && block->line_number == checkpoint.line_number)
+    {
+        return;
+    }
+
+    memset(&checkpoint, 0, sizeof(Recovery_Checkpoint_t));
+    checkpoint.line_number = block->line_number;
+    memcpy(checkpoint.position, sys_position, sizeof(sys_position));
+    checkpoint.feed_rate = block->programmed_rate;
+    checkpoint.spindle_speed = block->spindle_speed;
+    checkpoint.modal = gc_state.modal;
+    checkpoint.modal.spindle = block->condition & PL_COND_SPINDLE_MASK;
+    checkpoint.modal.coolant = block->condition & (PL_COND_FLAG_COOLANT_FLOOD | PL_COND_FLAG_COOLANT_MIST);
+    checkpoint.tool = gc_state.tool;
+    checkpoint.magic = RECOVERY_MAGIC;
+
+    checkpoint_valid = Recovery_Write(RECOVERY_ADDR_CHECKPOINT, &checkpoint, sizeof(Recovery_Checkpoint_t));
+}
+
+
+void Recovery_Task(void)
+{
+    Recovery_UpdatePosition();
+    Recovery_UpdateCheckpoint();
+}
+
+
+void Recovery_Invalidate(void)
+{
+    restore_pending = false;
+
+    if(backup_valid)
+    {
+        uint8_t magic = 0;
+
+        BackupRam_Write(RECOVERY_ADDR_POSITION + offsetof(Recovery_Position_t, magic), &magic, 1);
+        backup_valid = false;
+    }
+}
+
+
+bool Recovery_PositionAvailable(void)
+{
+    return restore_pending;
+}
+
+
+uint8_t Recovery_RestorePosition(void)
+{
+    if(!restore_pending)
+    {
+        return STATUS_RECOVERY_INVALID;
+    }
+
+    if(!Settings_ReadCoordData(restored.coord_select, gc_state.coord_system))
+    {
+        return STATUS_SETTING_READ_FAIL;
+    }
+
+    memcpy(sys_position, restored.position, sizeof(sys_position));
+    sys.is_homed = restored.homed;
+    gc_state.modal.coord_select = restored.coord_select;
+
+    Planner_SyncPosition();
+    GC_SyncPosition();
+
+    restore_pending = false;
+
+    return STATUS_OK;
+}
+
+
+const Recovery_Checkpoint_t *Recovery_GetCheckpoint(void)
+{
+    return checkpoint_valid ? &checkpoint : 0;
+}
+
+
+void Recovery_ClearCheckpoint(void)
+{
+    if(checkpoint_valid)
+    {
+        uint8_t magic = 0;
+
+        BackupRam_Write(RECOVERY_ADDR_CHECKPOINT + offsetof(Recovery_Checkpoint_t, magic), &magic, 1);
+        checkpoint_valid = false;
+    }
+}
+
+
+uint8_t Recovery_StartJob(int32_t line_number)
+{
+    if(line_number <= 0)
+    {
+        return STATUS_INVALID_STATEMENT;
+    }
+    if(sys.state != STATE_IDLE)
+    {
+        return STATUS_IDLE_ERROR;
+    }
+    if(BIT_IS_TRUE(settings.flags, BITFLAG_HOMING_ENABLE) && !sys.is_homed)
+    {
+        // Position must be known to move back to the resume line
+        return STATUS_MACHINE_NOT_HOMED;
+    }
+
+    // Parse the program in check mode to rebuild the parser state without motion
+    resume_line = line_number;
+    fast_forward = true;
+    sys.state = STATE_CHECK_MODE;
+
+    return STATUS_OK;
+}
+
+
+/* Returns to the start of the resume line: Retracts Z to the safe machine Z (or stays higher), restores spindle
+   and coolant, moves above the start point and plunges at RECOVERY_PLUNGE_FEED.
+   If the resume line is the checkpointed one, its start is the machine position recorded, when it began
+   executing, and the plunge is not faster than its feed.
+*/
+static void Recovery_MoveToStart(void)
+{
+    Planner_LineData_t pl_data;
+    float target[N_AXIS];
+    float position[N_AXIS];
+    float plunge_feed = RECOVERY_PLUNGE_FEED;
+
+    memset(&pl_data, 0, sizeof(Planner_LineData_t));
+    memcpy(target, gc_state.position, sizeof(target));
+
+    if(checkpoint_valid && checkpoint.line_number == resume_line)
+    {
+        System_ConvertArraySteps2Mpos(target, checkpoint.position);
+
+        if(checkpoint.modal.motion != MOTION_MODE_SEEK && checkpoint.feed_rate > 0.0)
+        {
+            plunge_feed = min(plunge_feed, checkpoint.feed_rate);
+        }
+    }
+
+    // Current position in parser coordinates
+    GC_SyncPosition();
+    memcpy(position, gc_state.position, sizeof(position));
+    Planner_SyncPosition();
+
+    pl_data.condition = PL_COND_FLAG_RAPID_MOTION;
+    pl_data.line_number = resume_line;
+
+#ifdef RECOVERY_SAFE_Z
+    float safe_z = max(position[Z_AXIS], RECOVERY_SAFE_Z);
+#else
+    float safe_z = max(position[Z_AXIS], -settings.homing_pulloff);
+#endif
+
+    position[Z_AXIS] = safe_z;
+    MC_Line(position, &pl_data);
+
+    // Waits for the retract and spindle speed
+    Spindle_Sync(gc_state.modal.spindle, gc_state.spindle_speed);
+    Coolant_Sync(gc_state.modal.coolant);
+
+    if(sys.abort)
+    {
+        return;
+    }
+
+    pl_data.condition = PL_COND_FLAG_RAPID_MOTION | gc_state.modal.spindle | gc_state.modal.coolant;
+    pl_data.spindle_speed = gc_state.spindle_speed;
+
+    memcpy(position, target, sizeof(position));
+    position[Z_AXIS] = safe_z;
+    MC_Line(position, &pl_data);
+
+    pl_data.condition &= ~PL_COND_FLAG_RAPID_MOTION;
+    pl_data.feed_rate = plunge_feed;
+    MC_Line(target, &pl_data);
+
+    memcpy(gc_state.position, target, sizeof(target));
+}
+
+
+void Recovery_CheckLine(const char *line)
+{
+    if(!fast_forward)
+    {
+        return;
+    }
+    if(sys.state != STATE_CHECK_MODE)
+    {
+        // Check mode was left by a reset
+        fast_forward = false;
+        return;
+    }
+    if(line[0] != 'N')
+    {
+        return;
+    }
+
+    uint8_t char_counter = 1;
+    float value;
+
+    if(!Read_Float(line, &char_counter, &value) || (int32_t)value < resume_line)
+    {
+        return;
+    }
+
+    fast_forward = false;
+    sys.state = STATE_IDLE;
+
+    Report_FeedbackMessage(MESSAGE_JOB_RESUME);
+    Recovery_MoveToStart();
+}
@@ -0,0 +1,69 @@
+/*
+  Recovery.h - Machine position backup in battery backed memory
+  Part of Grbl-Advanced
+
+  Copyright (c) 2021 Patrick F.
+
+  Grbl-Advanced is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl-Advanced is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl-Advanced.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef RECOVERY_H
+#define RECOVERY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "GCode.h"
+
+
+// Job checkpoint. Written while a job with line numbers (N words) is running.
+typedef struct
+{
+    int32_t line_number;        // Executing line
+    int32_t position[N_AXIS];   // Machine position (steps)
+    float feed_rate;
+    float spindle_speed;
+    GC_Modal_t modal;
+    uint8_t tool;
+    uint8_t magic;
+} Recovery_Checkpoint_t;
+
+
+// Reads the backup from the last power-up. Must be called once at startup, before any motion.
+void Recovery_Init(void);
+
+// Periodic task. Keeps the backup up to date while the machine is idle.
+void Recovery_Task(void);
+
+// Marks the backup invalid. Called whenever the steppers are started.
+void Recovery_Invalidate(void);
+
+// Returns true, if a position from before the last power-up can be restored.
+bool Recovery_PositionAvailable(void);
+
+// Restores machine position, homed state and WCS from the backup. Returns a status code.
+uint8_t Recovery_RestorePosition(void);
+
+// Returns the last job checkpoint or 0, if there is none
+const Recovery_Checkpoint_t *Recovery_GetCheckpoint(void);
+
+// Discards the job checkpoint. Called on program end.
+void Recovery_ClearCheckpoint(void);
+
+// Starts parsing the program without motion until line_number is reached. Returns a status code.
+uint8_t Recovery_StartJob(int32_t line_number);
+
+// Checks each g-code line during the fast-forward. Moves back to the start of the resume line, once it is reached.
+void Recovery_CheckLine(const char *line);
+
+
+#endif // RECOVERY_H
@@ -31,6 +31,8 @@
 #include "Config.h"
 #include "CoolantControl.h"
 #include "GCode.h"
+#include "HeightMap.h"
+#include "Recovery.h"
 #include "Limits.h"
 #include "Probe.h"
 #include "Settings.h"
@@ -38,6 +40,8 @@
 #include "Stepper.h"
 #include "System.h"
 #include "Report.h"
+#include "Scheduler.h"
+#include "SpindleVFD.h"
 
 #include "Print.h"
 #include "FIFO_USART.h"
@@ -211,6 +215,14 @@ void Report_FeedbackMessage(uint8_t message_code)
         Printf("Invalid Tool Number");
         break;
 
+    case MESSAGE_POSITION_RECOVERY:
+        Printf("'$RP' to restore last position");
+        break;
+
+    case MESSAGE_JOB_RESUME:
+        Printf("Resuming job");
+        break;
+
     case MESSAGE_CHECK_INPUTS:
     {
         uint8_t control = System_GetControlState(true);
@@ -250,7 +262,7 @@ void Report_InitMessage(void)
 // Grbl help message
 void Report_GrblHelp(void)
 {
-    Printf("[HLP:$$ $# $G $I $N $x=val $Nx=line $J=line $SLP $C $X $H $T ~ ! ? ctrl-x ctrl-y ctrl-w]\r\n");
+    Printf("[HLP:$$ $# $G $I $N $x=val $Nx=line $J=line $SLP $SCAN=x $M $M=x $MP=x $C $X $RP $RJ $RJ=x $H $T $Q ~ ! ? ctrl-x ctrl-y ctrl-w]\r\n");
 #ifndef GRBL_COMPATIBLE
     Printf("[GRBL-Advanced by Schildkroet]\r\n");
 #endif
@@ -299,6 +311,19 @@ void Report_GrblSettings(void)
     report_util_uint8_setting(40, BIT_IS_TRUE(settings.flags_ext, BITFLAG_HOMING_FORCE_SET_ORIGIN));
     report_util_uint8_setting(41, BIT_IS_TRUE(settings.flags_ext, BITFLAG_FORCE_INITIALIZATION_ALARM));
     report_util_uint8_setting(42, BIT_IS_TRUE(settings.flags_ext, BITFLAG_CHECK_LIMITS_AT_INIT));
+#ifdef ENABLE_DUAL_AXIS
+    report_util_float_setting(43, settings.gantry_offset[0], N_DECIMAL_SETTINGVALUE);
+    report_util_float_setting(44, settings.gantry_offset[1], N_DECIMAL_SETTINGVALUE);
+#endif
+
+    for (uint8_t idx = 0; idx < SPINDLE_TABLE_POINTS; idx++)
+    {
+        report_util_float_setting(SPINDLE_TABLE_RPM_START_VAL+idx, spindle_table.rpm[idx], N_DECIMAL_RPMVALUE);
+    }
+    for (uint8_t idx = 0; idx < SPINDLE_TABLE_POINTS; idx++)
+    {
+        report_util_float_setting(SPINDLE_TABLE_DUTY_START_VAL+idx, spindle_table.duty[idx], N_DECIMAL_SETTINGVALUE);
+    }
 
     Delay_ms(1);
 
@@ -419,6 +444,122 @@ void Report_ToolParams(uint8_t tool_nr)
 }
 
 
+// Prints main loop task statistics: run count, longest run time (us), budget overruns and
+// postponed runs.
+void Report_SchedulerStats(void)
+{
+    for(uint8_t id = 0; id < SCHEDULER_MAX_TASKS; id++)
+    {
+        const Scheduler_Task_t *task = Scheduler_GetTask(id);
+
+        if(task == 0 || task->func == 0)
+        {
+            continue;
+        }
+
+        Printf("[TASK:%s,%lu,%lu,%lu,%lu", task->name, task->runs, task->max_time, task->overruns, task->deferred);
+        Report_UtilFeedback_LineFeed();
+    }
+}
+
+
+// Prints the height map grid and the probed Z values (one row per line)
+void Report_HeightMap(void)
+{
+    const HeightMap_t *map = HeightMap_Get();
+
+    Printf("[HM:%d,%d,%d,", HeightMap_IsActive(), map->points[0], map->points[1]);
+    PrintFloat_CoordValue(map->origin[0]);
+    Printf(",");
+    PrintFloat_CoordValue(map->origin[1]);
+    Printf(",");
+    PrintFloat_CoordValue(map->spacing[0]);
+    Printf(",");
+    PrintFloat_CoordValue(map->spacing[1]);
+    Report_UtilFeedback_LineFeed();
+
+    for(uint8_t iy = 0; iy < map->points[1]; iy++)
+    {
+        Printf("[HMZ%d:", iy);
+        for(uint8_t ix = 0; ix < map->points[0]; ix++)
+        {
+            PrintFloat_CoordValue(map->z[iy][ix]);
+            if(ix < (map->points[0] - 1))
+            {
+                Printf(",");
+            }
+        }
+        Report_UtilFeedback_LineFeed();
+    }
+
+    Printf_Flush();
+}
+
+
+void Report_RecoveryCheckpoint(void)
+{
+    const Recovery_Checkpoint_t *cp = Recovery_GetCheckpoint();
+    float position[N_AXIS];
+
+    if(cp == 0)
+    {
+        return;
+    }
+
+    System_ConvertArraySteps2Mpos(position, cp->position);
+
+    Printf("[RJ:%d|MPos:", cp->line_number);
+    Report_AxisValue(position);
+
+    Printf("|GC:G");
+    if(cp->modal.motion >= MOTION_MODE_PROBE_TOWARD)
+    {
+        Printf("38.%d", cp->modal.motion - (MOTION_MODE_PROBE_TOWARD - 2));
+    }
+    else
+    {
+        Printf("%d", cp->modal.motion);
+    }
+    Printf(" G%d G%d G%d G%d", cp->modal.coord_select+54, cp->modal.plane_select+17, 21-cp->modal.units, cp->modal.distance+90);
+
+    switch(cp->modal.spindle)
+    {
+    case SPINDLE_ENABLE_CW:
+        Printf(" M3");
+        break;
+
+    case SPINDLE_ENABLE_CCW:
+        Printf(" M4");
+        break;
+
+    default:
+        Printf(" M5");
+        break;
+    }
+
+    if(cp->modal.coolant & PL_COND_FLAG_COOLANT_MIST)
+    {
+        Printf(" M7");
+    }
+    if(cp->modal.coolant & PL_COND_FLAG_COOLANT_FLOOD)
+    {
+        Printf(" M8");
+    }
+    if(cp->modal.coolant == 0)
+    {
+        Printf(" M9");
+    }
+
+    Printf(" T%d F", cp->tool);
+    PrintFloat_RateValue(cp->feed_rate);
+    Printf(" S");
+    Printf_Float(cp->spindle_speed, N_DECIMAL_RPMVALUE);
+
+    Report_UtilFeedback_LineFeed();
+    Printf_Flush();
+}
+
+
 // Prints Grbl NGC parameters (coordinate offsets, probing)
 void Report_NgcParams(void)
 {
@@ -877,7 +1018,7 @@ void Report_RealtimeStatus(void)
         Printf("|FS:");
         PrintFloat_RateValue(Stepper_GetRealtimeRate());
         Printf(",");
-        if(settings.enc_ppr > 0)
+        if(Spindle_RpmAvailable())
         {
             Printf_Float(Spindle_GetRPM(), N_DECIMAL_RPMVALUE);
         }
@@ -887,6 +1028,15 @@ void Report_RealtimeStatus(void)
         }
     }
 
+#ifdef ENABLE_VFD_MODBUS
+    // Report VFD output current
+    if (VFD_IsOnline())
+    {
+        Printf("|Ld:");
+        Printf_Float(VFD_GetLoad(), 1);
+    }
+#endif
+
     if (BIT_IS_TRUE(settings.flags_report, BITFLAG_REPORT_FIELD_PIN_STATE))
     {
         uint8_t lim_pin_state = Limits_GetState(true);
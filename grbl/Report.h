@@ -69,6 +69,7 @@
 
 #define STATUS_PROBE_ERROR                      39
 #define STATUS_TOOLS_READ_FAIL                  40
+#define STATUS_RECOVERY_INVALID                 41
 
 // Define Grbl alarm codes. Valid values (1-255). 0 is reserved.
 #define ALARM_HARD_LIMIT_ERROR          EXEC_ALARM_HARD_LIMIT
@@ -95,6 +96,8 @@
 #define MESSAGE_SLEEP_MODE              11
 #define MESSAGE_INVALID_TOOL            12
 #define MESSAGE_CHECK_INPUTS            13
+#define MESSAGE_POSITION_RECOVERY       14
+#define MESSAGE_JOB_RESUME              15
 
 
 // Prints system status messages.
@@ -130,9 +133,18 @@ void Report_TLSParams(void);
 // Print tool table
 void Report_ToolParams(uint8_t tool_nr);
 
+// Prints main loop task statistics
+void Report_SchedulerStats(void);
+
 // Prints Grbl NGC parameters (coordinate offsets, probe)
 void Report_NgcParams(void);
 
+// Prints height map
+void Report_HeightMap(void);
+
+// Prints the job checkpoint
+void Report_RecoveryCheckpoint(void);
+
 // Prints current g-code parser mode state
 void Report_GCodeModes(void);
 
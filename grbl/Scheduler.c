@@ -0,0 +1,144 @@
+/*
+  Scheduler.c - Cooperative task scheduler for the main loop
+  Part of Grbl-Advanced
+
+  Copyright (c) 2017-2020 Patrick F.
+
+  Grbl-Advanced is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl-Advanced is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl-Advanced.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include "Config.h"
+#include "Scheduler.h"
+#include "util.h"
+#include "System32.h"
+
+
+extern uint32_t millis(void);
+
+
+static Scheduler_Task_t tasks[SCHEDULER_MAX_TASKS];
+
+
+// Microseconds passed since a DWT cycle counter timestamp
+static uint32_t Scheduler_MicrosSince(uint32_t cycles)
+{
+    return (DWT_CYCCNT_REG - cycles) / (SystemCoreClock / 1000000);
+}
+
+
+void Scheduler_Init(void)
+{
+    memset(tasks, 0, sizeof(tasks));
+}
+
+
+void Scheduler_AddTask(uint8_t id, const char *name, Scheduler_TaskFunc_t func, uint16_t period, uint16_t budget)
+{
+    if(id >= SCHEDULER_MAX_TASKS)
+    {
+        return;
+    }
+
+    memset(&tasks[id], 0, sizeof(Scheduler_Task_t));
+    tasks[id].func = func;
+    tasks[id].name = name;
+    tasks[id].period = period;
+    tasks[id].budget = budget;
+    tasks[id].last_run = millis();
+}
+
+
+/* Runs every due task once, highest priority first. A task is due when its period has elapsed.
+   Once the time spent in this pass exceeds SCHEDULER_PASS_BUDGET_US, lower priority tasks are
+   postponed to a later pass, unless they already missed their deadline by a full period. This keeps
+   the realtime task responsive, while slow tasks like reports still get CPU time eventually.
+   Tasks are never re-entered, so nested realtime check points within a task are safe.
+*/
+void Scheduler_Run(void)
+{
+    uint32_t pass_start = DWT_CYCCNT_REG;
+    uint32_t now = millis();
+
+    for(uint8_t id = 0; id < SCHEDULER_MAX_TASKS; id++)
+    {
+        Scheduler_Task_t *task = &tasks[id];
+
+        if(task->func == 0 || task->running)
+        {
+            continue;
+        }
+
+        uint32_t elapsed = now - task->last_run;
+
+        if(elapsed < task->period)
+        {
+            // Not due yet
+            continue;
+        }
+
+        if(id != TASK_REALTIME && Scheduler_MicrosSince(pass_start) > SCHEDULER_PASS_BUDGET_US)
+        {
+            uint32_t deadline = task->period ? (2 * task->period) : 2;
+
+            if(elapsed < deadline)
+            {
+                task->deferred++;
+                continue;
+            }
+        }
+
+        task->running = 1;
+        uint32_t start = DWT_CYCCNT_REG;
+
+        task->func();
+
+        uint32_t duration = Scheduler_MicrosSince(start);
+        task->running = 0;
+
+        task->last_run = now;
+        task->runs++;
+
+        if(duration > task->max_time)
+        {
+            task->max_time = duration;
+        }
+        if(duration > task->budget)
+        {
+            task->overruns++;
+        }
+    }
+}
+
+
+const Scheduler_Task_t *Scheduler_GetTask(uint8_t id)
+{
+    if(id >= SCHEDULER_MAX_TASKS)
+    {
+        return 0;
+    }
+
+    return &tasks[id];
+}
+
+
+void Scheduler_ResetStats(void)
+{
+    for(uint8_t id = 0; id < SCHEDULER_MAX_TASKS; id++)
+    {
+        tasks[id].runs = 0;
+        tasks[id].max_time = 0;
+        tasks[id].overruns = 0;
+        tasks[id].deferred = 0;
+    }
+}
@@ -0,0 +1,74 @@
+/*
+  Scheduler.h - Cooperative task scheduler for the main loop
+  Part of Grbl-Advanced
+
+  Copyright (c) 2017-2020 Patrick F.
+
+  Grbl-Advanced is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl-Advanced is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl-Advanced.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+
+// Task IDs. Lower ID means higher priority.
+#define TASK_REALTIME           0   // Realtime state machine and segment prep
+#define TASK_COMM               1   // GrIP packet reception
+#define TASK_ETHERNET           2   // TCP server
+#define TASK_VFD                3   // Modbus VFD spindle
+#define TASK_SCAN               4   // Scanning probe point streaming
+#define TASK_REPORT             5   // Realtime status report
+#define TASK_RECOVERY           6   // Position backup
+
+#define SCHEDULER_MAX_TASKS     7
+
+
+typedef void (*Scheduler_TaskFunc_t)(void);
+
+
+typedef struct
+{
+    Scheduler_TaskFunc_t func;
+    const char *name;
+    uint16_t period;        // Minimum time between runs (ms). 0 = every pass.
+    uint16_t budget;        // Expected maximum run time (us)
+    uint32_t last_run;      // (ms)
+    uint8_t running;
+
+    // Statistics
+    uint32_t runs;
+    uint32_t max_time;      // Longest run time (us)
+    uint32_t overruns;      // Runs exceeding the budget
+    uint32_t deferred;      // Runs postponed, because the pass budget was used up
+} Scheduler_Task_t;
+
+
+// Initialize scheduler and clear task table
+void Scheduler_Init(void);
+
+// Register a task at a given priority slot
+void Scheduler_AddTask(uint8_t id, const char *name, Scheduler_TaskFunc_t func, uint16_t period, uint16_t budget);
+
+// Execute all due tasks in order of priority. Called from every realtime check point.
+void Scheduler_Run(void);
+
+// Get task data for reporting
+const Scheduler_Task_t *Scheduler_GetTask(uint8_t id);
+
+// Clear task statistics
+void Scheduler_ResetStats(void);
+
+
+#endif // SCHEDULER_H
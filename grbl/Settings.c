@@ -37,9 +37,12 @@
 
 static void WriteGlobalSettings(void);
 static uint8_t ReadGlobalSettings(void);
+static void WriteSpindleTable(void);
+static uint8_t ReadSpindleTable(void);
 
 
 Settings_t settings;
+SpindleTable_t spindle_table;
 
 
 // Initialize the config subsystem
@@ -55,6 +58,12 @@ void Settings_Init(void)
         Report_GrblSettings();
     }
 
+    if (!ReadSpindleTable())
+    {
+        memset(&spindle_table, 0, sizeof(SpindleTable_t));
+        WriteSpindleTable();
+    }
+
     // Read tool table
     TT_Init();
 }
@@ -85,6 +94,10 @@ void Settings_Restore(const uint8_t restore_flag)
         settings.homing_seek_rate = DEFAULT_HOMING_SEEK_RATE;
         settings.homing_debounce_delay = DEFAULT_HOMING_DEBOUNCE_DELAY;
         settings.homing_pulloff = DEFAULT_HOMING_PULLOFF;
+#ifdef ENABLE_DUAL_AXIS
+        settings.gantry_offset[0] = DEFAULT_GANTRY_OFFSET_1;
+        settings.gantry_offset[1] = DEFAULT_GANTRY_OFFSET_2;
+#endif
 
         // Flags
         settings.flags = 0;
@@ -226,6 +239,9 @@ void Settings_Restore(const uint8_t restore_flag)
         settings.tls_position[Z_AXIS] = 0;
 
         WriteGlobalSettings();
+
+        memset(&spindle_table, 0, sizeof(SpindleTable_t));
+        WriteSpindleTable();
     }
 
     if (restore_flag & SETTINGS_RESTORE_PARAMETERS)
@@ -376,6 +392,44 @@ uint8_t Settings_ReadToolTable(ToolTable_t *table)
 }
 
 
+void Settings_StoreHeightMap(const HeightMap_t *map)
+{
+#if (USE_EXT_EEPROM)
+    // Does not fit into external EEPROM. Map is kept in RAM only.
+    (void)map;
+#else
+    Nvm_Write(EEPROM_ADDR_HEIGHTMAP, (uint8_t*)map, sizeof(HeightMap_t));
+
+    uint8_t crc = CRC_CalculateCRC8((const uint8_t *)map, sizeof(HeightMap_t));
+    Nvm_WriteByte(EEPROM_ADDR_HEIGHTMAP + sizeof(HeightMap_t), crc);
+
+    Nvm_Update();
+#endif
+}
+
+
+uint8_t Settings_ReadHeightMap(HeightMap_t *map)
+{
+#if (USE_EXT_EEPROM)
+    (void)map;
+
+    return false;
+#else
+    if(!(Nvm_Read((uint8_t*)map, EEPROM_ADDR_HEIGHTMAP, sizeof(HeightMap_t))))
+    {
+        return false;
+    }
+    uint8_t crc = CRC_CalculateCRC8((const uint8_t *)map, sizeof(HeightMap_t));
+    if (crc != Nvm_ReadByte(EEPROM_ADDR_HEIGHTMAP + sizeof(HeightMap_t)))
+    {
+        return false;
+    }
+
+    return true;
+#endif
+}
+
+
 // Reads startup line from EEPROM. Updated pointed line string data.
 uint8_t Settings_ReadBuildInfo(char *line)
 {
@@ -483,6 +537,36 @@ uint8_t Settings_StoreGlobalSetting(uint8_t parameter, float value)
             }
         }
     }
+    else if(parameter >= SPINDLE_TABLE_RPM_START_VAL && parameter < (SPINDLE_TABLE_RPM_START_VAL + SPINDLE_TABLE_POINTS))
+    {
+        if(value < 0.0)
+        {
+            return STATUS_NEGATIVE_VALUE;
+        }
+        spindle_table.rpm[parameter - SPINDLE_TABLE_RPM_START_VAL] = value;
+        WriteSpindleTable();
+        // Re-initialize spindle rpm calibration
+        Spindle_Init();
+
+        return 0;
+    }
+    else if(parameter >= SPINDLE_TABLE_DUTY_START_VAL && parameter < (SPINDLE_TABLE_DUTY_START_VAL + SPINDLE_TABLE_POINTS))
+    {
+        if(value < 0.0)
+        {
+            return STATUS_NEGATIVE_VALUE;
+        }
+        if(value > 100.0)
+        {
+            return STATUS_INVALID_STATEMENT;
+        }
+        spindle_table.duty[parameter - SPINDLE_TABLE_DUTY_START_VAL] = value;
+        WriteSpindleTable();
+        // Re-initialize spindle rpm calibration
+        Spindle_Init();
+
+        return 0;
+    }
     else
     {
         // Store non-axis Grbl settings
@@ -776,6 +860,16 @@ uint8_t Settings_StoreGlobalSetting(uint8_t parameter, float value)
             }
             break;
 
+#ifdef ENABLE_DUAL_AXIS
+        case 43:
+            settings.gantry_offset[0] = value;
+            break;
+
+        case 44:
+            settings.gantry_offset[1] = value;
+            break;
+#endif
+
         default:
             return (STATUS_INVALID_STATEMENT);
         }
@@ -783,6 +877,9 @@ uint8_t Settings_StoreGlobalSetting(uint8_t parameter, float value)
 
     WriteGlobalSettings();
 
+    // Travel, steps/mm or homing direction may have changed
+    Limits_UpdateSoftBounds();
+
     return 0;
 }
 
@@ -920,3 +1017,31 @@ static uint8_t ReadGlobalSettings(void)
 
     return true;
 }
+
+
+static void WriteSpindleTable(void)
+{
+    Nvm_Write(EEPROM_ADDR_SPINDLE_TABLE, (uint8_t *)&spindle_table, sizeof(SpindleTable_t));
+
+    uint8_t crc = CRC_CalculateCRC8((const uint8_t *)&spindle_table, sizeof(SpindleTable_t));
+    Nvm_WriteByte(EEPROM_ADDR_SPINDLE_TABLE + sizeof(SpindleTable_t), crc);
+
+    Nvm_Update();
+}
+
+
+static uint8_t ReadSpindleTable(void)
+{
+    if (!(Nvm_Read((uint8_t *)&spindle_table, EEPROM_ADDR_SPINDLE_TABLE, sizeof(SpindleTable_t))))
+    {
+        return false;
+    }
+
+    uint8_t crc = CRC_CalculateCRC8((const uint8_t *)&spindle_table, sizeof(SpindleTable_t));
+    if (crc != Nvm_ReadByte(EEPROM_ADDR_SPINDLE_TABLE + sizeof(SpindleTable_t)))
+    {
+        return false;
+    }
+
+    return true;
+}
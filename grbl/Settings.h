@@ -23,13 +23,20 @@
 #define SETTINGS_H
 
 #include <stdint.h>
+#include "Config.h"
 #include "util.h"
 #include "ToolTable.h"
+#include "HeightMap.h"
 
 
 // Version of the EEPROM data. Will be used to migrate existing data from older versions of Grbl
 // when firmware is upgraded. Always stored in byte 0 of eeprom
-#define SETTINGS_VERSION                        8  // NOTE: Check settings_reset() when moving to next version.
+// NOTE: The dual axis gantry offsets change the layout of the global settings.
+#ifdef ENABLE_DUAL_AXIS
+    #define SETTINGS_VERSION                    9  // NOTE: Check settings_reset() when moving to next version.
+#else
+    #define SETTINGS_VERSION                    8  // NOTE: Check settings_reset() when moving to next version.
+#endif
 
 
 // Define bit flag masks for the boolean settings in settings.input_invert_mask
@@ -90,13 +97,15 @@
 // Define EEPROM memory address location values for Grbl settings and parameters
 // NOTE: Default 1KB EEPROM. The upper half is reserved for parameters and
 // the startup script. The lower half contains the global settings and space for future
-// developments.
+// developments. The internal flash EEPROM has 4KB, the height map is stored above the first 1KB.
 #define EEPROM_ADDR_VERSION                 0U
-#define EEPROM_ADDR_GLOBAL                  1U      // +163
+#define EEPROM_ADDR_GLOBAL                  1U      // +163, +172 with ENABLE_DUAL_AXIS
 #define EEPROM_ADDR_TOOLTABLE               180U    // +320
-#define EEPROM_ADDR_PARAMETERS              512U    // +160
+#define EEPROM_ADDR_PARAMETERS              512U    // +168
+#define EEPROM_ADDR_SPINDLE_TABLE           688U    // +49
 #define EEPROM_ADDR_STARTUP_BLOCK           768U    // +150
 #define EEPROM_ADDR_BUILD_INFO              926U    // +80
+#define EEPROM_ADDR_HEIGHTMAP               1024U   // +1620 (+1 CRC). Internal EEPROM only.
 
 // CRC addresses
 #define EEPROM_ADDR_GLOBAL_CRC              1018U
@@ -116,6 +125,11 @@
 #define AXIS_SETTINGS_START_VAL             100 // NOTE: Reserving settings values >= 100 for axis settings. Up to 255.
 #define AXIS_SETTINGS_INCREMENT             10  // Must be greater than the number of axis settings
 
+// Spindle RPM to PWM table. $50-$55 set the RPM of each point, $60-$65 the PWM duty cycle (%).
+#define SPINDLE_TABLE_POINTS                6
+#define SPINDLE_TABLE_RPM_START_VAL         50
+#define SPINDLE_TABLE_DUTY_START_VAL        60
+
 #ifndef SETTINGS_RESTORE_ALL
   #define SETTINGS_RESTORE_ALL              0xFF // All bitflags
 #endif
@@ -162,11 +176,26 @@ typedef struct
     float homing_seek_rate;
     uint16_t homing_debounce_delay;
     float homing_pulloff;
+
+#ifdef ENABLE_DUAL_AXIS
+    float gantry_offset[2];     // Squaring offsets of the dual Y motors (mm)
+#endif
 } Settings_t;
 #pragma pack(pop)
 
 
+// Piecewise linear spindle speed model. Only the leading points with increasing RPM are used.
+// With less than two valid points, the linear model between rpm_min and rpm_max applies.
+// NOTE: rpm_min and rpm_max still limit the programmed RPM.
+typedef struct
+{
+    float rpm[SPINDLE_TABLE_POINTS];
+    float duty[SPINDLE_TABLE_POINTS];   // Percent
+} SpindleTable_t;
+
+
 extern Settings_t settings;
+extern SpindleTable_t spindle_table;
 
 
 // Initialize the configuration subsystem (load settings from EEPROM)
@@ -192,6 +221,12 @@ void Settings_StoreToolTable(const ToolTable_t *table);
 // Read tool table
 uint8_t Settings_ReadToolTable(ToolTable_t *table);
 
+// Stores height map in EEPROM
+void Settings_StoreHeightMap(const HeightMap_t *map);
+
+// Read height map
+uint8_t Settings_ReadHeightMap(HeightMap_t *map);
+
 // Reads an EEPROM startup line to the protocol line variable
 uint8_t Settings_ReadStartupLine(uint8_t n, char *line);
 
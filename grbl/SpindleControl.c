@@ -28,13 +28,51 @@
 #include "SpindleControl.h"
 #include "Config.h"
 #include "Encoder.h"
+#include "MotionControl.h"
+#include "Scheduler.h"
+#include "SpindleVFD.h"
+#include "PID.h"
 
 
-static float pwm_gradient; // Precalulated value to speed up rpm to PWM conversions.
+#if (SPINDLE_PWM_MAX_VALUE > 0xFFFF)
+    #error "SPINDLE_PWM_FREQUENCY too low for 16 bit spindle PWM timer"
+#endif
+
+#if defined(ENABLE_MILL_SPINDLE_ENCODER) && defined(ENABLE_DUAL_AXIS)
+    #error "ENABLE_MILL_SPINDLE_ENCODER uses the Y1 limit input needed by ENABLE_DUAL_AXIS"
+#endif
+
+
+// Segment of the piecewise linear spindle speed model: pwm = offset + rpm*gradient up to rpm_end.
+typedef struct
+{
+    float rpm_end;
+    float offset;
+    float gradient;
+} PwmSegment_t;
+
+
+static void Spindle_UpdatePwmSegments(void);
+static uint16_t Spindle_TrimPwm(uint16_t pwm_value);
+
+
+// Precalculated segments to speed up rpm to PWM conversions.
+static PwmSegment_t pwm_segments[SPINDLE_TABLE_POINTS-1];
+static uint8_t pwm_segment_cnt = 0;
 static uint8_t spindle_enabled = 0;
 static uint8_t spindle_dir_cw = 1;
 
-extern uint32_t spindle_rpm;
+// PWM value of the spindle speed model and closed-loop correction (PWM counts)
+static volatile uint16_t pwm_feedforward = SPINDLE_PWM_OFF_VALUE;
+static volatile int32_t pwm_trim = 0;
+
+#ifdef ENABLE_SPINDLE_PID
+// Speeds normalized to rpm_max, output normalized to PWM range
+static float pid_in = 0.0, pid_out = 0.0, pid_set = 0.0;
+static PID_t spindle_pid;
+#endif
+
+extern uint32_t millis(void);
 
 
 void Spindle_Init(void)
@@ -43,14 +81,24 @@ void Spindle_Init(void)
     // combined unless configured otherwise.
     GPIO_InitGPIO(GPIO_SPINDLE);
 
-    TIM1_Init();
+    TIM1_Init(SPINDLE_PWM_MAX_VALUE);
 
-    if (BIT_IS_TRUE(settings.flags_ext, BITFLAG_LATHE_MODE))
+    if (BIT_IS_TRUE(settings.flags_ext, BITFLAG_LATHE_MODE) || Spindle_EncoderAvailable())
     {
         Encoder_Init(settings.enc_ppr);
     }
 
-    pwm_gradient = SPINDLE_PWM_RANGE/(settings.rpm_max-settings.rpm_min);
+#ifdef ENABLE_VFD_MODBUS
+    VFD_Init();
+#endif
+
+#ifdef ENABLE_SPINDLE_PID
+    PID_Create(&spindle_pid, &pid_in, &pid_out, &pid_set, SPINDLE_PID_KP, SPINDLE_PID_KI, SPINDLE_PID_KD);
+    PID_SampleTime(&spindle_pid, SPINDLE_PID_PERIOD);
+    PID_Limits(&spindle_pid, -SPINDLE_PID_MAX_TRIM, SPINDLE_PID_MAX_TRIM);
+#endif
+
+    Spindle_UpdatePwmSegments();
     spindle_dir_cw = 1;
 
     Spindle_Stop();
@@ -62,9 +110,13 @@ void Spindle_Init(void)
 // Called by spindle_init(), spindle_set_speed(), spindle_set_state(), and mc_reset().
 void Spindle_Stop(void)
 {
-    TIM1->CCR1 = TIM1_INIT; // Disable PWM. Output voltage is zero.
+    TIM1->CCR1 = SPINDLE_PWM_MAX_VALUE; // Disable PWM. Output voltage is zero.
     spindle_enabled = 0;
 
+#ifdef ENABLE_VFD_MODBUS
+    VFD_Stop();
+#endif
+
     if (BIT_IS_TRUE(settings.input_invert_mask, BITFLAG_INVERT_SPINDLE_PIN))
     {
         GPIO_SetBits(GPIO_SPINDLE_ENA_PORT, GPIO_SPINDLE_ENA_PIN);
@@ -97,9 +149,10 @@ uint8_t Spindle_GetState(void)
 
 // Sets spindle speed PWM output and enable pin, if configured. Called by spindle_set_state()
 // and stepper ISR. Keep routine small and efficient.
-void Spindle_SetSpeed(uint8_t pwm_value)
+void Spindle_SetSpeed(uint16_t pwm_value)
 {
-    TIM1->CCR1 = TIM1_INIT - pwm_value; // Set PWM output level.
+    pwm_feedforward = pwm_value;
+    TIM1->CCR1 = SPINDLE_PWM_MAX_VALUE - Spindle_TrimPwm(pwm_value); // Set PWM output level.
 #ifdef SPINDLE_ENABLE_OFF_WITH_ZERO_SPEED
     if (pwm_value == SPINDLE_PWM_OFF_VALUE)
     {
@@ -121,7 +174,7 @@ void Spindle_SetSpeed(uint8_t pwm_value)
 #else
     if (pwm_value == SPINDLE_PWM_OFF_VALUE)
     {
-        TIM1->CCR1 = TIM1_INIT;    // Disable PWM. Output voltage is zero.
+        TIM1->CCR1 = SPINDLE_PWM_MAX_VALUE;    // Disable PWM. Output voltage is zero.
         TIM_Cmd(TIM1, DISABLE); // Disable PWM. Output voltage is zero.
         spindle_enabled = 0;
     }
@@ -131,19 +184,195 @@ void Spindle_SetSpeed(uint8_t pwm_value)
         spindle_enabled = 1;
     }
 #endif
+
+#ifdef ENABLE_VFD_MODBUS
+    if(spindle_enabled)
+    {
+        // Speed including override, computed together with pwm_value
+        VFD_SetSpeed(sys.spindle_speed, spindle_dir_cw);
+    }
+    else
+    {
+        VFD_Stop();
+    }
+#endif
+}
+
+
+// Measured spindle speed (RPM)
+float Spindle_GetRPM(void)
+{
+#ifdef ENABLE_VFD_MODBUS
+    if(!Spindle_EncoderAvailable())
+    {
+        return VFD_GetRPM();
+    }
+#endif
+
+    return Encoder_GetSpeed() * 60.0;
+}
+
+
+bool Spindle_EncoderAvailable(void)
+{
+    if(settings.enc_ppr == 0)
+    {
+        return false;
+    }
+
+#ifdef ENABLE_MILL_SPINDLE_ENCODER
+    return true;
+#else
+    return BIT_IS_TRUE(settings.flags_ext, BITFLAG_LATHE_MODE);
+#endif
+}
+
+
+bool Spindle_RpmAvailable(void)
+{
+    if(Spindle_EncoderAvailable())
+    {
+        return true;
+    }
+
+#ifdef ENABLE_VFD_MODBUS
+    return VFD_IsOnline();
+#else
+    return false;
+#endif
+}
+
+
+void Spindle_WaitAtSpeed(float fallback_delay, uint8_t mode)
+{
+#ifdef ENABLE_SPINDLE_AT_SPEED
+    // Measured RPM is only available with spindle encoder or VFD
+    if(!Spindle_RpmAvailable() || sys.spindle_speed < 1.0)
+    {
+        Delay_sec(fallback_delay, mode);
+        return;
+    }
+
+    uint32_t start = millis();
+    uint32_t stable = start;
+
+    while(1)
+    {
+        if(sys.abort)
+        {
+            return;
+        }
+
+        if(mode == DELAY_MODE_DWELL)
+        {
+            Protocol_ExecuteRealtime();
+        }
+        else   // DELAY_MODE_SYS_SUSPEND
+        {
+            // Execute scheduled tasks only to avoid nesting suspend loops.
+            Scheduler_Run();
+
+            if(sys.suspend & SUSPEND_RESTART_RETRACT)
+            {
+                // Bail, if safety door reopens.
+                return;
+            }
+        }
+
+        uint32_t now = millis();
+
+        if(fabsf(Spindle_GetRPM() - sys.spindle_speed) > (sys.spindle_speed * (SPINDLE_AT_SPEED_TOLERANCE / 100.0)))
+        {
+            // Out of tolerance. Restart stable time.
+            stable = now;
+        }
+        else if((now - stable) >= SPINDLE_AT_SPEED_STABLE_TIME)
+        {
+            // At speed
+            return;
+        }
+
+        if((now - start) >= SPINDLE_AT_SPEED_TIMEOUT)
+        {
+            MC_Reset(); // Stop spindle and motion
+            System_SetExecAlarm(EXEC_ALARM_SPINDLE_AT_SPEED);
+            return;
+        }
+    }
+#else
+    Delay_sec(fallback_delay, mode);
+#endif
 }
 
 
-uint32_t Spindle_GetRPM(void)
+// Applies closed-loop correction to a PWM value of the spindle speed model
+static uint16_t Spindle_TrimPwm(uint16_t pwm_value)
 {
-    return spindle_rpm;
+    int32_t trim = pwm_trim;
+
+    if(trim == 0 || pwm_value == SPINDLE_PWM_OFF_VALUE)
+    {
+        return pwm_value;
+    }
+
+    int32_t pwm = (int32_t)pwm_value + trim;
+
+    if(pwm < SPINDLE_PWM_MIN_VALUE)
+    {
+        return SPINDLE_PWM_MIN_VALUE;
+    }
+    if(pwm > (int32_t)SPINDLE_PWM_MAX_VALUE)
+    {
+        return SPINDLE_PWM_MAX_VALUE;
+    }
+
+    return (uint16_t)pwm;
+}
+
+
+// Closed-loop spindle speed control. The PWM value of the speed model is the feed-forward term,
+// the PID output is added on top. The output limits follow the feed-forward value, so the sum never
+// exceeds the PWM range and the integral term can't wind up while the output is saturated.
+void Spindle_UpdatePID(void)
+{
+#ifdef ENABLE_SPINDLE_PID
+    uint16_t feedforward = pwm_feedforward;
+
+    if(!spindle_enabled || feedforward == SPINDLE_PWM_OFF_VALUE || settings.rpm_max <= 0.0 || !Spindle_EncoderAvailable() ||
+       BIT_IS_TRUE(settings.flags, BITFLAG_LASER_MODE))
+    {
+        // Open-loop. Restart with zero correction.
+        PID_Manual(&spindle_pid);
+        pid_out = 0.0;
+        pwm_trim = 0;
+
+        return;
+    }
+
+    float ff = (float)feedforward / SPINDLE_PWM_MAX_VALUE;
+    float lower = ((float)SPINDLE_PWM_MIN_VALUE / SPINDLE_PWM_MAX_VALUE) - ff;
+    float upper = 1.0 - ff;
+
+    PID_Limits(&spindle_pid, max(lower, -SPINDLE_PID_MAX_TRIM), min(upper, SPINDLE_PID_MAX_TRIM));
+    PID_EnableAuto(&spindle_pid);
+
+    pid_in = fabsf(Encoder_GetSpeed() * 60.0) / settings.rpm_max;
+    pid_set = sys.spindle_speed / settings.rpm_max;
+
+    PID_Compute(&spindle_pid);
+
+    pwm_trim = (int32_t)(pid_out * SPINDLE_PWM_MAX_VALUE);
+
+    // Stepper ISR may have loaded a new segment value meanwhile
+    TIM1->CCR1 = SPINDLE_PWM_MAX_VALUE - Spindle_TrimPwm(pwm_feedforward);
+#endif
 }
 
 
 // Called by spindle_set_state() and step segment generator. Keep routine small and efficient.
-uint8_t Spindle_ComputePwmValue(float rpm) // 328p PWM register is 8-bit.
+uint16_t Spindle_ComputePwmValue(float rpm)
 {
-    uint8_t pwm_value;
+    uint16_t pwm_value;
 
     rpm *= (0.010*sys.spindle_speed_ovr); // Scale by spindle speed override value.
 
@@ -169,16 +398,70 @@ uint8_t Spindle_ComputePwmValue(float rpm) // 328p PWM register is 8-bit.
     }
     else
     {
-        // Compute intermediate PWM value with linear spindle speed model.
-        // NOTE: A nonlinear model could be installed here, if required, but keep it VERY light-weight.
+        // Compute intermediate PWM value with piecewise linear spindle speed model.
+        uint8_t idx = 0;
+
+        while(idx < (pwm_segment_cnt-1) && rpm > pwm_segments[idx].rpm_end)
+        {
+            idx++;
+        }
+
+        float pwm = floorf(pwm_segments[idx].offset + rpm*pwm_segments[idx].gradient);
+
         sys.spindle_speed = rpm;
-        pwm_value = floorf((rpm-settings.rpm_min)*pwm_gradient) + SPINDLE_PWM_MIN_VALUE;
+        if(pwm < SPINDLE_PWM_MIN_VALUE)
+        {
+            pwm_value = SPINDLE_PWM_MIN_VALUE;
+        }
+        else if(pwm > SPINDLE_PWM_MAX_VALUE)
+        {
+            pwm_value = SPINDLE_PWM_MAX_VALUE;
+        }
+        else
+        {
+            pwm_value = (uint16_t)pwm;
+        }
     }
 
     return pwm_value;
 }
 
 
+// Builds the segments of the spindle speed model from the RPM table. Without a valid table,
+// a single segment maps rpm_min..rpm_max linearly to the PWM range.
+static void Spindle_UpdatePwmSegments(void)
+{
+    uint8_t points = 1;
+
+    // Use leading points with increasing rpm
+    while(points < SPINDLE_TABLE_POINTS && spindle_table.rpm[points] > spindle_table.rpm[points-1])
+    {
+        points++;
+    }
+
+    if(points < 2)
+    {
+        pwm_segments[0].rpm_end = settings.rpm_max;
+        pwm_segments[0].gradient = SPINDLE_PWM_RANGE/(settings.rpm_max-settings.rpm_min);
+        pwm_segments[0].offset = SPINDLE_PWM_MIN_VALUE - settings.rpm_min*pwm_segments[0].gradient;
+        pwm_segment_cnt = 1;
+
+        return;
+    }
+
+    for(uint8_t idx = 0; idx < (points-1); idx++)
+    {
+        float pwm_start = (spindle_table.duty[idx]/100.0)*SPINDLE_PWM_MAX_VALUE;
+        float pwm_end = (spindle_table.duty[idx+1]/100.0)*SPINDLE_PWM_MAX_VALUE;
+
+        pwm_segments[idx].rpm_end = spindle_table.rpm[idx+1];
+        pwm_segments[idx].gradient = (pwm_end-pwm_start)/(spindle_table.rpm[idx+1]-spindle_table.rpm[idx]);
+        pwm_segments[idx].offset = pwm_start - spindle_table.rpm[idx]*pwm_segments[idx].gradient;
+    }
+    pwm_segment_cnt = points-1;
+}
+
+
 // Immediately sets spindle running state with direction and spindle rpm via PWM, if enabled.
 // Called by g-code parser spindle_sync(), parking retract and restore, g-code program end,
 // sleep, and spindle stop override.
@@ -245,29 +528,30 @@ void Spindle_Sync(uint8_t state, float rpm)
 
     Protocol_BufferSynchronize(); // Empty planner buffer to ensure spindle is set when programmed.
     Spindle_SetState(state, rpm);
+
+    if(state != SPINDLE_DISABLE && BIT_IS_FALSE(settings.flags, BITFLAG_LASER_MODE))
+    {
+        // Resume motion once spindle reached its speed
+        Spindle_WaitAtSpeed(0.0, DELAY_MODE_DWELL);
+    }
 }
 
 
-void Spindle_SetSurfaceSpeed(float x_pos)
+// Called by step segment generator for G96 motions.
+float Spindle_SurfaceSpeedToRpm(float surface_speed, float x_pos, float limit)
 {
     if(isEqual_f(x_pos, 0.0))
     {
         x_pos = 0.5;
     }
     float u = (fabsf(x_pos) * 2) * M_PI;
-    float rpm = gc_state.spindle_speed / (u / 1000);
+    float rpm = surface_speed / (u / 1000);
 
     // Limit Max RPM
-    if(gc_state.spindle_limit > 0)
+    if(limit > 0)
     {
-        rpm = min(rpm, gc_state.spindle_limit);
-    }
-    sys.spindle_speed = rpm;
-
-    if(sys.state == STATE_CHECK_MODE)
-    {
-        return;
+        rpm = min(rpm, limit);
     }
 
-    Spindle_SetSpeed(Spindle_ComputePwmValue(rpm));
+    return rpm;
 }
@@ -23,6 +23,7 @@
 #define SPINDLECONTROL_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 
 #define SPINDLE_NO_SYNC             false
@@ -32,7 +33,7 @@
 #define SPINDLE_STATE_CW            BIT(0)
 #define SPINDLE_STATE_CCW           BIT(1)
 
-#define SPINDLE_PWM_MAX_VALUE       200 // Don't change.
+#define SPINDLE_PWM_MAX_VALUE       (F_TIMER_SPINDLE/SPINDLE_PWM_FREQUENCY) // Timer period. Must be <= 65535.
 #ifndef SPINDLE_PWM_MIN_VALUE
 #define SPINDLE_PWM_MIN_VALUE       1   // Must be greater than zero.
 #endif
@@ -59,15 +60,27 @@ void Spindle_Sync(uint8_t state, float rpm);
 void Spindle_SetState(uint8_t state, float rpm);
 
 // Sets spindle PWM quickly for stepper ISR. Also called by spindle_set_state().
-// NOTE: 328p PWM register is 8-bit.
-void Spindle_SetSpeed(uint8_t pwm_value);
+void Spindle_SetSpeed(uint16_t pwm_value);
 
-uint32_t Spindle_GetRPM(void);
+float Spindle_GetRPM(void);
 
-// Computes 328p-specific PWM register value for the given RPM for quick updating.
-uint8_t Spindle_ComputePwmValue(float rpm);
+// True, if a spindle encoder is connected. Always in lathe mode, on a mill with ENABLE_MILL_SPINDLE_ENCODER.
+bool Spindle_EncoderAvailable(void);
 
-void Spindle_SetSurfaceSpeed(float x_pos);
+// True, if the actual spindle speed is measured (encoder or VFD)
+bool Spindle_RpmAvailable(void);
+
+// Waits until the spindle runs at the commanded speed. Without spindle encoder, waits fallback_delay seconds.
+void Spindle_WaitAtSpeed(float fallback_delay, uint8_t mode);
+
+// Computes PWM register value for the given RPM for quick updating.
+uint16_t Spindle_ComputePwmValue(float rpm);
+
+// Trims spindle PWM to hold the commanded RPM. Called from the 1 ms system tick every SPINDLE_PID_PERIOD.
+void Spindle_UpdatePID(void);
+
+// Spindle speed for constant surface speed (m/min) at given X position (mm). Limited to max RPM, if greater than zero.
+float Spindle_SurfaceSpeedToRpm(float surface_speed, float x_pos, float limit);
 
 
 #endif // SPINDLECONTROL_H
@@ -0,0 +1,199 @@
+/*
+  SpindleVFD.c - Modbus RTU VFD spindle driver
+  Part of Grbl-Advanced
+
+  Copyright (c) 2021 Patrick F.
+
+  Grbl-Advanced is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl-Advanced is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl-Advanced.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "Config.h"
+#include "SpindleVFD.h"
+#include "ModbusRTU.h"
+#include "System32.h"
+
+
+#define VFD_REQ_NONE        0
+#define VFD_REQ_FREQ        1
+#define VFD_REQ_CONTROL     2
+#define VFD_REQ_STATUS      3
+
+#define VFD_UNKNOWN         0xFFFF  // Forces a write
+
+
+extern uint32_t millis(void);
+
+
+#ifdef ENABLE_VFD_MODBUS
+
+// Requested by spindle control. Written from interrupts. Both are updated and read together with
+// interrupts disabled, so the task never sends a new frequency with a stale direction.
+static volatile uint16_t cmd_control = VFD_CMD_STOP;
+static volatile uint16_t cmd_freq = 0;
+
+// Last values acknowledged by the VFD
+static uint16_t vfd_control = VFD_UNKNOWN;
+static uint16_t vfd_freq = VFD_UNKNOWN;
+
+static uint8_t request = VFD_REQ_NONE;
+static uint16_t request_value = 0;
+static uint32_t last_poll = 0;
+static uint8_t errors = 0;
+static bool online = false;
+
+static float freq_out = 0.0;    // Hz
+static float current_out = 0.0; // A
+
+
+void VFD_Init(void)
+{
+    Modbus_Init(VFD_MODBUS_BAUDRATE);
+
+    cmd_control = VFD_CMD_STOP;
+    cmd_freq = 0;
+    vfd_control = VFD_UNKNOWN;
+    vfd_freq = VFD_UNKNOWN;
+    request = VFD_REQ_NONE;
+    last_poll = millis();
+    errors = 0;
+    online = false;
+    freq_out = 0.0;
+    current_out = 0.0;
+}
+
+
+void VFD_SetSpeed(float rpm, bool cw)
+{
+    if(rpm <= 0.0)
+    {
+        cmd_control = VFD_CMD_STOP;
+        return;
+    }
+
+    uint16_t freq = (uint16_t)((rpm / VFD_RPM_PER_HZ) * VFD_FREQ_SCALE);
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    cmd_freq = freq;
+    cmd_control = cw ? VFD_CMD_RUN_CW : VFD_CMD_RUN_CCW;
+
+    __set_PRIMASK(primask);
+}
+
+
+void VFD_Stop(void)
+{
+    cmd_control = VFD_CMD_STOP;
+}
+
+
+void VFD_Task(void)
+{
+    uint8_t result = Modbus_Poll();
+
+    if(result != MODBUS_IDLE && result != MODBUS_BUSY)
+    {
+        if(result == MODBUS_OK)
+        {
+            errors = 0;
+            online = true;
+
+            switch(request)
+            {
+            case VFD_REQ_FREQ:
+                vfd_freq = request_value;
+                break;
+
+            case VFD_REQ_CONTROL:
+                vfd_control = request_value;
+                break;
+
+            case VFD_REQ_STATUS:
+                freq_out = Modbus_GetRegister(0) / VFD_FREQ_SCALE;
+                current_out = Modbus_GetRegister(1) / VFD_CURRENT_SCALE;
+                break;
+
+            default:
+                break;
+            }
+        }
+        else if(++errors >= VFD_MAX_ERRORS)
+        {
+            // Resend all commands, once the VFD answers again
+            errors = VFD_MAX_ERRORS;
+            online = false;
+            vfd_control = VFD_UNKNOWN;
+            vfd_freq = VFD_UNKNOWN;
+            freq_out = 0.0;
+            current_out = 0.0;
+        }
+        request = VFD_REQ_NONE;
+    }
+
+    if(request != VFD_REQ_NONE || !Modbus_Ready())
+    {
+        return;
+    }
+
+    // Commands take precedence over status polling. Set frequency before starting the VFD.
+    __disable_irq();
+    uint16_t freq = cmd_freq;
+    uint16_t control = cmd_control;
+    __enable_irq();
+
+    if(freq != vfd_freq)
+    {
+        if(Modbus_WriteRegister(VFD_MODBUS_ADDRESS, VFD_REG_FREQ_SET, freq))
+        {
+            request = VFD_REQ_FREQ;
+            request_value = freq;
+        }
+    }
+    else if(control != vfd_control)
+    {
+        if(Modbus_WriteRegister(VFD_MODBUS_ADDRESS, VFD_REG_CONTROL, control))
+        {
+            request = VFD_REQ_CONTROL;
+            request_value = control;
+        }
+    }
+    else if((millis() - last_poll) >= VFD_POLL_INTERVAL)
+    {
+        // Output frequency and current
+        if(Modbus_ReadRegisters(VFD_MODBUS_ADDRESS, VFD_REG_FREQ_OUT, 2))
+        {
+            request = VFD_REQ_STATUS;
+            last_poll = millis();
+        }
+    }
+}
+
+
+bool VFD_IsOnline(void)
+{
+    return online;
+}
+
+
+float VFD_GetRPM(void)
+{
+    return freq_out * VFD_RPM_PER_HZ;
+}
+
+
+float VFD_GetLoad(void)
+{
+    return current_out;
+}
+
+#endif // ENABLE_VFD_MODBUS
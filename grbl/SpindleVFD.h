@@ -0,0 +1,47 @@
+/*
+  SpindleVFD.h - Modbus RTU VFD spindle driver
+  Part of Grbl-Advanced
+
+  Copyright (c) 2021 Patrick F.
+
+  Grbl-Advanced is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl-Advanced is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl-Advanced.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SPINDLEVFD_H
+#define SPINDLEVFD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+// Initialize Modbus line and reset VFD state. VFD is stopped on next update.
+void VFD_Init(void);
+
+// Request speed and direction. Zero rpm stops the VFD. Safe to call from interrupts.
+void VFD_SetSpeed(float rpm, bool cw);
+void VFD_Stop(void);
+
+// Sends pending commands and polls the VFD status. Runs as scheduler task.
+void VFD_Task(void);
+
+// True, while the VFD answers
+bool VFD_IsOnline(void);
+
+// Actual speed derived from output frequency (RPM)
+float VFD_GetRPM(void);
+
+// Output current (A)
+float VFD_GetLoad(void);
+
+
+#endif // SPINDLEVFD_H
@@ -34,6 +34,9 @@
 #include "Stepper.h"
 #include "GPIO.h"
 #include "System32.h"
+#include "Encoder.h"
+#include "ProbeScan.h"
+#include "Recovery.h"
 
 
 // Some useful constants.
@@ -77,7 +80,10 @@
     #pragma message("Max stepper rate: 120KHz")
 #endif
 
-#define G96_UPDATE_CNT      20
+// Stepper ISR variants. See Stepper_SelectISR().
+#define ISR_MODE_NORMAL     0
+#define ISR_MODE_PROBING    1
+#define ISR_MODE_HOMING     2
 
 
 // Stores the planner block Bresenham algorithm execution data for the segments in the segment
@@ -105,9 +111,7 @@ typedef struct
     uint16_t cycles_per_tick;  // Step distance traveled per ISR tick, aka step rate.
     uint8_t  st_block_index;   // Stepper block data index. Uses this information to execute this segment.
     uint8_t amass_level;    // Indicates AMASS level for the ISR to execute this segment
-    uint8_t spindle_pwm;
-
-    uint8_t backlash_motion;
+    uint16_t spindle_pwm;
 } Stepper_Segment_t;
 
 
@@ -124,7 +128,12 @@ typedef struct
     uint8_t dir_outbits;
     uint32_t steps[N_AXIS];
 
+    // Steps already counted in sys_position, but not output yet. Tracked while probing only.
+    uint8_t pending_outbits;
+    uint8_t pending_dirbits;
+
     uint16_t step_count;       // Steps remaining in line segment motion
+    uint16_t cycles_per_tick;  // Timer cycles of the current ISR period
     uint8_t exec_block_index; // Tracks the current st_block index. Change indicates new block.
     Stepper_Block_t *exec_block;   // Pointer to the block data for the segment being executed
     Stepper_Segment_t *exec_segment;  // Pointer to the segment being executed
@@ -160,7 +169,7 @@ typedef struct
     float decelerate_after; // Deceleration ramp start measured from end of block (mm)
 
     float inv_rate;    // Used by PWM laser mode to speed up segment calculations.
-    uint8_t current_spindle_pwm;
+    uint16_t current_spindle_pwm;
 } Stepper_PrepData_t;
 
 
@@ -177,18 +186,95 @@ static uint8_t segment_next_head;
 static uint8_t step_port_invert_mask;
 static uint8_t dir_port_invert_mask;
 
-// Pointers for the step segment being prepped from the planner buffer. Accessed only by the
-// main program. Pointers may be planning segments or planner blocks ahead of what being executed.
+// Actual state of the driver enable output
+static volatile bool drivers_enabled = false;
+
+// Pointers for the step segment being prepped from the planner buffer. Accessed by the main
+// program and the segment refill interrupt, guarded by prep_lock. Pointers may be planning
+// segments or planner blocks ahead of what being executed.
 static Planner_Block_t *pl_block;     // Pointer to the planner block being prepped
 static Stepper_Block_t *st_prep_block;  // Pointer to the stepper block data being prepped
 
 static Stepper_PrepData_t prep;
 
+// Segment refill guard. While the main program holds the lock, the refill interrupt only
+// records that it was requested. The request is re-issued when the lock is released.
+static volatile uint8_t prep_lock = 0;
+static volatile uint8_t prep_pending = 0;
+
+static void Stepper_PrepareSegments(void);
+
+// Specialised stepper ISR, selected by Stepper_SelectISR() when the steppers wake up.
+static void Stepper_ISR_Mill(void);
+static void (*volatile stepper_isr)(void) = Stepper_ISR_Mill;
+
 static float tim_ovr = 0;
-static uint8_t update_g96 = G96_UPDATE_CNT;
 
+#ifdef ENABLE_ELECTRONIC_GEARBOX
+#define EGB_OFF             0
+#define EGB_WAIT            1   // Z-axis is accelerating
+#define EGB_ENGAGED         2   // Z-axis follows spindle encoder
+#define EGB_TAP             3   // Z-axis position follows signed encoder count, segments are not executed
+
+#define TAP_FLAG_DEPTH      BIT(0)  // Programmed depth reached
+#define TAP_FLAG_RETRACT    BIT(1)  // Spindle reversed, finish at the start position
+#define TAP_FLAG_FAULT      BIT(2)  // Overshoot limit exceeded, tap stopped
+
+#define TAP_DIR_COUNTS      4       // Encoder counts to detect the counting direction of the forward turning spindle
+
+// Electronic gearbox. Z steps since engagement follow encoder counts since engagement * ratio.
+static volatile uint8_t egb_state = EGB_OFF;
+static uint32_t egb_ratio;          // Z steps per encoder count (Q16.16)
+static uint32_t egb_accel_steps;    // Z steps until engagement
+static int32_t egb_z_start;
+static uint32_t egb_enc_start;
+
+// Rigid tapping
+static int32_t egb_tap_dir;         // Z direction into the hole (+1/-1)
+static int32_t egb_enc_dir;         // Counting direction of the forward turning spindle (+1/-1). 0 = not known yet.
+static int32_t egb_tap_depth;       // Z steps to the programmed depth
+static int32_t egb_tap_limit;       // Z steps to the maximum overshoot
+static uint8_t egb_z_dir_neg;       // Current Z direction pin state. 0xFF = not set yet.
+static volatile uint8_t egb_tap_flags;
+#endif
 
-float current_backlash[N_AXIS] = {};
+// Backlash compensation. When an axis reverses, the ISR injects the play as extra steps at
+// BACKLASH_STEP_RATE_HZ. These steps are not part of any planner block and not counted in sys_position.
+static uint32_t backlash_steps[N_LINEAR_AXIS];
+static uint32_t backlash_remaining[N_LINEAR_AXIS];
+static uint8_t backlash_dir_bits;   // Last direction of each axis. Set bit = negative.
+static uint8_t backlash_pending;    // Axes with remaining backlash steps
+static uint8_t backlash_idle;       // Linear axes without steps in the executing block. Direction pin kept.
+static uint8_t backlash_enabled;
+static uint32_t backlash_cycles;
+
+#ifdef ENABLE_PARALLEL_HOMING
+#define HOMING_RATE_ONE     (1UL<<24)   // One step per tick (Q8.24)
+#define HOMING_TICK_MIN_HZ  8000        // Minimum tick rate. Keeps the step timing of slow channels smooth.
+
+// Parallel homing channel. Rates are in steps per tick (Q8.24). The phase accumulator steps on overflow.
+typedef struct
+{
+    volatile uint8_t run;
+    volatile uint8_t stop;      // Stop requested by the limit interrupts
+    volatile uint8_t triggered; // Stop request taken. trigger holds the position.
+    uint8_t dir_neg;
+    uint8_t dir_set;            // Direction pin is set, stepping starts
+    uint32_t steps_left;
+    uint32_t accel_steps;       // Steps done while accelerating. Same distance is needed to stop.
+    uint32_t rate;
+    uint32_t rate_min;          // Rate after one step from rest
+    uint32_t rate_max;
+    uint32_t accel;             // Rate change per tick
+    uint32_t phase;
+    volatile int32_t position;
+    volatile int32_t trigger;
+} Stepper_HomingChannel_t;
+
+static Stepper_HomingChannel_t homing_ch[STEPPER_HOMING_CHANNELS];
+static volatile uint8_t homing_gen = 0;
+static float homing_tick_hz;
+#endif
 
 
 /*    BLOCK VELOCITY PROFILE DEFINITION
@@ -239,17 +325,75 @@ void Stepper_Init(void)
     // Init TIM9
     TIM9_Init();
 
+#ifdef STEPPER_PREP_IN_ISR
+    // Segment refill runs in PendSV, below every other interrupt
+    NVIC_SetPriority(PendSV_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), 15, 0));
+#endif
+    prep_lock = 0;
+    prep_pending = 0;
+
     if(BIT_IS_TRUE(settings.flags, BITFLAG_HOMING_ENABLE))
     {
         Stepper_Disable(1);
     }
 
     tim_ovr = 0;
-    update_g96 = G96_UPDATE_CNT;
 
-    for(int i = 0; i < N_AXIS; i++)
+    // Before the first move, play is assumed to be taken up in homing direction
+    backlash_dir_bits = 0;
+    for(uint8_t idx = 0; idx < N_LINEAR_AXIS; idx++)
     {
-        current_backlash[i] = 0.0;
+        if(BIT_IS_TRUE(settings.homing_dir_mask, BIT(idx)))
+        {
+            backlash_dir_bits |= BIT(idx);
+        }
+    }
+    backlash_idle = 0;
+
+    Stepper_ResetBacklash();
+}
+
+
+// Clears pending backlash steps. The last direction of each axis is kept as tracked by the ISR,
+// e.g. the pull-off direction after homing.
+void Stepper_ResetBacklash(void)
+{
+    for(uint8_t idx = 0; idx < N_LINEAR_AXIS; idx++)
+    {
+        backlash_remaining[idx] = 0;
+    }
+
+    backlash_pending = 0;
+    backlash_cycles = 0;
+}
+
+
+// Converts backlash settings into steps. Called before every cycle, while the stepper ISR is off.
+static void Stepper_UpdateBacklash(void)
+{
+    backlash_enabled = 0;
+
+    for(uint8_t idx = 0; idx < N_LINEAR_AXIS; idx++)
+    {
+        backlash_steps[idx] = 0;
+
+        if(BIT_IS_TRUE(settings.flags_ext, BITFLAG_ENABLE_BACKLASH_COMP) && settings.backlash[idx] > 0.0)
+        {
+            backlash_steps[idx] = lroundf(settings.backlash[idx] * settings.steps_per_mm[idx]);
+        }
+
+        if(backlash_remaining[idx] > backlash_steps[idx])
+        {
+            backlash_remaining[idx] = backlash_steps[idx];
+        }
+        if(backlash_remaining[idx] == 0)
+        {
+            backlash_pending &= ~BIT(idx);
+        }
+        if(backlash_steps[idx] > 0)
+        {
+            backlash_enabled = 1;
+        }
     }
 }
 
@@ -258,6 +402,11 @@ void Stepper_Init(void)
 // enabled. Startup init and limits call this function but shouldn't start the cycle.
 void Stepper_WakeUp(void)
 {
+#ifdef ENABLE_RECOVERY
+    // Position changes from now on
+    Recovery_Invalidate();
+#endif
+
     // Enable stepper drivers.
     if(BIT_IS_TRUE(settings.flags, BITFLAG_INVERT_ST_ENABLE))
     {
@@ -267,6 +416,7 @@ void Stepper_WakeUp(void)
     {
         GPIO_ResetBits(GPIO_ENABLE_PORT, GPIO_ENABLE_PIN);
     }
+    drivers_enabled = true;
 
     // Give steppers some time to wake up
     Delay_ms(10);
@@ -274,6 +424,10 @@ void Stepper_WakeUp(void)
     // Initialize stepper output bits to ensure first ISR call does not step.
     //st.step_outbits = step_port_invert_mask;
     st.step_outbits = 0;
+    st.pending_outbits = 0;
+
+    Stepper_UpdateBacklash();
+    Stepper_SelectISR();
 
     // Enable Stepper Driver Interrupt
     TIM_Cmd(TIM9, ENABLE);
@@ -307,6 +461,8 @@ void Stepper_Disable(uint8_t ovr_disable)
         pin_state = true;
     }
 
+    drivers_enabled = !pin_state;
+
     if(BIT_IS_TRUE(settings.flags, BITFLAG_INVERT_ST_ENABLE))
     {
         pin_state = !pin_state;
@@ -323,12 +479,370 @@ void Stepper_Disable(uint8_t ovr_disable)
 }
 
 
+bool Stepper_DriversEnabled(void)
+{
+    return drivers_enabled;
+}
+
+
 void Stepper_Ovr(float ovr)
 {
     tim_ovr = ovr;
 }
 
 
+#ifdef ENABLE_ELECTRONIC_GEARBOX
+void Stepper_GearboxSetup(float pitch, float accel_dist)
+{
+    egb_state = EGB_OFF;
+
+    if(settings.enc_ppr == 0)
+    {
+        return;
+    }
+
+    egb_ratio = (uint32_t)lroundf((pitch * settings.steps_per_mm[Z_AXIS] * 65536.0) / settings.enc_ppr);
+    egb_accel_steps = (uint32_t)lroundf(accel_dist * settings.steps_per_mm[Z_AXIS]);
+    egb_z_start = sys_position[Z_AXIS];
+
+    egb_state = EGB_WAIT;
+}
+
+
+void Stepper_GearboxStop(void)
+{
+    egb_state = EGB_OFF;
+}
+
+
+void Stepper_TapStart(float pitch, float depth, float overshoot)
+{
+    egb_state = EGB_OFF;
+
+    egb_ratio = (uint32_t)lroundf((fabsf(pitch) * settings.steps_per_mm[Z_AXIS] * 65536.0) / settings.enc_ppr);
+    egb_tap_dir = (depth < 0.0) ? -1 : 1;
+    egb_tap_depth = lroundf(fabsf(depth) * settings.steps_per_mm[Z_AXIS]);
+    egb_tap_limit = lroundf((fabsf(depth) + overshoot) * settings.steps_per_mm[Z_AXIS]);
+    egb_enc_dir = 0;
+    egb_z_start = sys_position[Z_AXIS];
+    egb_enc_start = Encoder_GetValue();
+    egb_z_dir_neg = 0xFF;
+    egb_tap_flags = 0;
+
+    // Every tick does at most one step. This limits the Z step rate to the maximum rate plus the headroom
+    // of the gearbox (EGB_TICK_SPEEDUP) to catch up after spindle speed variations.
+    uint32_t cycles = (uint32_t)((F_TIMER_STEPPER * (EGB_TICK_SPEEDUP / 256.0)) /
+                                 (settings.max_rate[Z_AXIS] * settings.steps_per_mm[Z_AXIS] / 60.0));
+
+    cycles = max(cycles, STEP_TIMER_MIN);
+    cycles = min(cycles, 0xFFFF);
+
+    TIM9->ARR = (uint16_t)cycles;
+    TIM9->CCR1 = (uint16_t)(cycles * 0.6);
+    st.cycles_per_tick = (uint16_t)cycles;
+
+    egb_state = EGB_TAP;
+}
+
+
+void Stepper_TapRetract(void)
+{
+    egb_tap_flags |= TAP_FLAG_RETRACT;
+}
+
+
+bool Stepper_TapDepthReached(void)
+{
+    return (egb_tap_flags & TAP_FLAG_DEPTH) != 0;
+}
+
+
+bool Stepper_TapActive(void)
+{
+    return egb_state == EGB_TAP;
+}
+
+
+bool Stepper_TapFailed(void)
+{
+    return (egb_tap_flags & TAP_FLAG_FAULT) != 0;
+}
+
+
+/* Rigid tapping tick. Steps the Z-axis towards the position given by the encoder count since the start, in both
+   directions. The tap starts with the spindle at rest, so Z accelerates with the spindle. The spindle turning
+   forward moves Z into the hole, reversed out of it. Z never goes above the start position.
+   If Z would pass the overshoot limit (spindle did not reverse), stepping stops and an alarm is raised. The main
+   loop does the reset. Once retracting and back at the start, the gearbox is decoupled and the ISR finishes the
+   empty cycle.
+*/
+static inline void Stepper_TapTick(void)
+{
+    st.step_outbits = 0;
+
+    int32_t counts = (int32_t)(Encoder_GetValue() - egb_enc_start);
+
+    if(egb_enc_dir == 0)
+    {
+        // Spindle starts forward. Take its counting direction from the first counts.
+        if(abs(counts) < TAP_DIR_COUNTS)
+        {
+            return;
+        }
+        egb_enc_dir = (counts < 0) ? -1 : 1;
+    }
+    counts *= egb_enc_dir;
+
+    int32_t z_target = (int32_t)(((int64_t)max(counts, 0) * egb_ratio) >> 16);
+    int32_t z_pos = (sys_position[Z_AXIS] - egb_z_start) * egb_tap_dir;
+
+    if(z_target > egb_tap_limit)
+    {
+        egb_tap_flags |= TAP_FLAG_FAULT;
+        egb_state = EGB_OFF;
+        System_SetExecAlarm(EXEC_ALARM_RIGID_TAP);
+        return;
+    }
+    if(z_pos >= egb_tap_depth)
+    {
+        egb_tap_flags |= TAP_FLAG_DEPTH;
+    }
+    if(z_pos == z_target)
+    {
+        if((egb_tap_flags & TAP_FLAG_RETRACT) && z_pos == 0)
+        {
+            egb_state = EGB_OFF;
+        }
+        return;
+    }
+
+    uint8_t dir_neg = ((z_target > z_pos) == (egb_tap_dir < 0));
+
+    if(dir_neg != egb_z_dir_neg)
+    {
+        egb_z_dir_neg = dir_neg;
+
+        if(((backlash_dir_bits >> Z_AXIS) & 1) != dir_neg)
+        {
+            // Reversal is not compensated while tapping. The play is taken up by the move itself.
+            backlash_dir_bits ^= BIT(Z_AXIS);
+            backlash_remaining[Z_AXIS] = 0;
+            backlash_pending &= ~BIT(Z_AXIS);
+        }
+
+        if(dir_neg ^ ((dir_port_invert_mask >> Z_DIRECTION_BIT) & 1))
+        {
+            GPIO_SetBits(GPIO_DIR_Z_PORT, GPIO_DIR_Z_PIN);
+        }
+        else
+        {
+            GPIO_ResetBits(GPIO_DIR_Z_PORT, GPIO_DIR_Z_PIN);
+        }
+
+        // Step in the next tick to keep the direction setup time
+        return;
+    }
+
+    st.step_outbits = (1<<Z_STEP_BIT);
+    sys_position[Z_AXIS] += dir_neg ? -1 : 1;
+}
+#endif
+
+
+#ifdef ENABLE_PARALLEL_HOMING
+void Stepper_HomingInit(float step_rate)
+{
+    homing_gen = 0;
+    memset(homing_ch, 0, sizeof(homing_ch));
+
+    // Two ticks per step at the fastest rate, so every channel steps at most every other tick
+    uint32_t cycles = (uint32_t)(F_TIMER_STEPPER / max(2.0 * step_rate, HOMING_TICK_MIN_HZ));
+
+    cycles = max(cycles, STEP_TIMER_MIN);
+
+    TIM9->ARR = (uint16_t)cycles;
+    TIM9->CCR1 = (uint16_t)(cycles * 0.6);
+    st.cycles_per_tick = (uint16_t)cycles;
+    homing_tick_hz = (float)F_TIMER_STEPPER / cycles;
+
+    homing_gen = 1;
+}
+
+
+void Stepper_HomingMove(uint8_t channel, int32_t steps, float rate, float accel)
+{
+    Stepper_HomingChannel_t *ch = &homing_ch[channel];
+
+    if(steps == 0)
+    {
+        return;
+    }
+
+    float rate_max = (rate / homing_tick_hz) * HOMING_RATE_ONE;
+    float accel_tick = (accel / (homing_tick_hz * homing_tick_hz)) * HOMING_RATE_ONE;
+
+    ch->rate_max = (uint32_t)min(rate_max, (float)HOMING_RATE_ONE);
+    ch->accel = max((uint32_t)accel_tick, 1);
+    ch->rate_min = min((uint32_t)sqrtf(2.0 * ch->accel * HOMING_RATE_ONE), ch->rate_max);
+    ch->rate = ch->rate_min;
+    ch->phase = 0;
+    ch->accel_steps = 0;
+    ch->steps_left = labs(steps);
+    ch->dir_neg = (steps < 0);
+    ch->dir_set = 0;
+    ch->stop = 0;
+    ch->triggered = 0;
+
+    ch->run = 1;
+}
+
+
+void Stepper_HomingStop(uint8_t channel)
+{
+    homing_ch[channel].stop = 1;
+}
+
+
+bool Stepper_HomingBusy(uint8_t channel)
+{
+    return homing_ch[channel].run != 0;
+}
+
+
+int32_t Stepper_HomingPosition(uint8_t channel)
+{
+    return homing_ch[channel].position;
+}
+
+
+bool Stepper_HomingTriggered(uint8_t channel, int32_t *trigger)
+{
+    *trigger = homing_ch[channel].trigger;
+
+    return homing_ch[channel].triggered != 0;
+}
+
+
+static inline void Stepper_HomingSetDir(uint8_t channel, uint8_t dir_neg)
+{
+    GPIO_TypeDef *port = GPIO_DIR_A_PORT;
+    uint16_t pin = GPIO_DIR_A_PIN;
+
+    if(channel == X_STEP_BIT)
+    {
+        port = GPIO_DIR_X_PORT;
+        pin = GPIO_DIR_X_PIN;
+    }
+    else if(channel == Y_STEP_BIT)
+    {
+        port = GPIO_DIR_Y_PORT;
+        pin = GPIO_DIR_Y_PIN;
+    }
+    else if(channel == Z_STEP_BIT)
+    {
+        port = GPIO_DIR_Z_PORT;
+        pin = GPIO_DIR_Z_PIN;
+    }
+
+    if(dir_neg ^ ((dir_port_invert_mask >> channel) & 1))
+    {
+        GPIO_SetBits(port, pin);
+    }
+    else
+    {
+        GPIO_ResetBits(port, pin);
+    }
+
+    if(channel < N_LINEAR_AXIS)
+    {
+        // Backlash is taken up in this direction
+        if(dir_neg)
+        {
+            backlash_dir_bits |= BIT(channel);
+        }
+        else
+        {
+            backlash_dir_bits &= ~BIT(channel);
+        }
+    }
+}
+
+
+/* Parallel homing tick. Every running channel follows its own trapezoid: It accelerates from rest, until it
+   either reaches its maximum rate or has as many steps left as it took to accelerate, and decelerates from
+   there. A stop request shortens the remaining steps to the stopping distance, so the channel decelerates
+   right away and the position at the request is kept as the trigger point. Steps are counted in
+   sys_position, except for the second Y motor.
+*/
+static inline void Stepper_HomingTick(void)
+{
+    st.step_outbits = 0;
+
+    for(uint8_t idx = 0; idx < STEPPER_HOMING_CHANNELS; idx++)
+    {
+        Stepper_HomingChannel_t *ch = &homing_ch[idx];
+
+        if(!ch->run)
+        {
+            continue;
+        }
+        if(!ch->dir_set)
+        {
+            // Step in the next tick to keep the direction setup time
+            Stepper_HomingSetDir(idx, ch->dir_neg);
+            ch->dir_set = 1;
+            continue;
+        }
+
+        if(ch->stop && !ch->triggered)
+        {
+            ch->trigger = ch->position;
+            ch->triggered = 1;
+            ch->steps_left = min(ch->steps_left, ch->accel_steps);
+        }
+
+        bool accelerating = false;
+
+        if(ch->steps_left <= ch->accel_steps)
+        {
+            ch->rate = (ch->rate > ch->rate_min + ch->accel) ? (ch->rate - ch->accel) : ch->rate_min;
+        }
+        else if(ch->rate < ch->rate_max)
+        {
+            ch->rate = min(ch->rate + ch->accel, ch->rate_max);
+            accelerating = true;
+        }
+
+        ch->phase += ch->rate;
+
+        if(ch->phase >= HOMING_RATE_ONE && ch->steps_left > 0)
+        {
+            ch->phase -= HOMING_RATE_ONE;
+            st.step_outbits |= BIT(idx);
+            ch->position += ch->dir_neg ? -1 : 1;
+#ifdef ENABLE_DUAL_AXIS
+            if(idx != A_STEP_BIT)
+#endif
+            {
+                sys_position[idx] += ch->dir_neg ? -1 : 1;
+            }
+
+            if(accelerating)
+            {
+                ch->accel_steps++;
+            }
+            ch->steps_left--;
+        }
+
+        if(ch->steps_left == 0)
+        {
+            ch->run = 0;
+        }
+    }
+}
+#endif
+
+
 /* "The Stepper Driver Interrupt" - This timer interrupt is the workhorse of Grbl. Grbl employs
    the venerable Bresenham line algorithm to manage and exactly synchronize multi-axis moves.
    Unlike the popular DDA algorithm, the Bresenham algorithm is not susceptible to numerical
@@ -373,8 +887,11 @@ void Stepper_Ovr(float ovr)
    which for Grbl must be less than 33.3usec (@30kHz ISR rate). Oscilloscope measured time in
    ISR is 5usec typical and 25usec maximum, well below requirement.
    NOTE: This ISR expects at least one step to be executed per segment.
+   NOTE: The body is inlined into a specialised variant for each machine type and motion mode, so
+   the constant checks fold away at compile time. Stepper_MainISR() dispatches to the variant
+   selected by Stepper_SelectISR().
 */
-void Stepper_MainISR(void)
+static inline __attribute__((always_inline)) void Stepper_ISRBody(const bool lathe, const uint8_t mode)
 {
     if(st.step_outbits & (1<<X_STEP_BIT))
     {
@@ -389,7 +906,7 @@ void Stepper_MainISR(void)
             GPIO_SetBits(GPIO_STEP_X_PORT, GPIO_STEP_X_PIN);
         }
     }
-    if (BIT_IS_FALSE(settings.flags_ext, BITFLAG_LATHE_MODE))
+    if(!lathe)
     {
         if (st.step_outbits & (1 << Y_STEP_BIT))
         {
@@ -418,6 +935,7 @@ void Stepper_MainISR(void)
             GPIO_SetBits(GPIO_STEP_Z_PORT, GPIO_STEP_Z_PIN);
         }
     }
+#if (N_AXIS > 3)
     if(st.step_outbits & (1<<A_STEP_BIT))
     {
         if(step_port_invert_mask & (1<<A_STEP_BIT))
@@ -431,19 +949,29 @@ void Stepper_MainISR(void)
             GPIO_SetBits(GPIO_STEP_A_PORT, GPIO_STEP_A_PIN);
         }
     }
-    if(st.step_outbits & (1<<B_STEP_BIT))
+#endif
+    // NOTE: B axis has no step output. Position is tracked only.
+
+    if(mode == ISR_MODE_PROBING)
     {
-        if(step_port_invert_mask & (1<<B_STEP_BIT))
-        {
-            // Low pulse
-            //GPIO_ResetBits(GPIO_STEP_B_PORT, GPIO_STEP_B_PIN);
-        }
-        else
-        {
-            // High pulse
-            //GPIO_SetBits(GPIO_STEP_B_PORT, GPIO_STEP_B_PIN);
-        }
+        st.pending_outbits = 0;
+    }
+
+#ifdef ENABLE_ELECTRONIC_GEARBOX
+    if(egb_state == EGB_TAP)
+    {
+        Stepper_TapTick();
+        return;
     }
+#endif
+
+#ifdef ENABLE_PARALLEL_HOMING
+    if(mode == ISR_MODE_HOMING && homing_gen)
+    {
+        Stepper_HomingTick();
+        return;
+    }
+#endif
 
     // If there is no step segment, attempt to pop one from the stepper buffer
     if(st.exec_segment == 0)
@@ -462,7 +990,18 @@ void Stepper_MainISR(void)
             }
 
             int32_t new_cycles_per_tick = st.exec_segment->cycles_per_tick;
-            if(sys.sync_move == 1)
+#ifdef ENABLE_ELECTRONIC_GEARBOX
+            if(egb_state == EGB_ENGAGED)
+            {
+                // Tick faster than planned. The gearbox holds back surplus ticks.
+                new_cycles_per_tick = (new_cycles_per_tick * EGB_TICK_SPEEDUP) >> 8;
+                if(new_cycles_per_tick < STEP_TIMER_MIN)
+                {
+                    new_cycles_per_tick = STEP_TIMER_MIN;
+                }
+            }
+#else
+            if(lathe && sys.sync_move == 1)
             {
                 new_cycles_per_tick = st.exec_segment->cycles_per_tick * tim_ovr;
                 new_cycles_per_tick = st.exec_segment->cycles_per_tick + new_cycles_per_tick;
@@ -475,12 +1014,14 @@ void Stepper_MainISR(void)
                     new_cycles_per_tick = STEP_TIMER_MIN-50;
                 }
             }
+#endif
 
             // Update TIM9 register for next interrupt
             //TIM9->ARR = st.exec_segment->cycles_per_tick;
             //TIM9->CCR1 = (uint16_t)(st.exec_segment->cycles_per_tick * 0.6);
             TIM9->ARR = (uint16_t)new_cycles_per_tick;
             TIM9->CCR1 = (uint16_t)(new_cycles_per_tick * 0.6);
+            st.cycles_per_tick = (uint16_t)new_cycles_per_tick;
             st.step_count = st.exec_segment->n_step; // NOTE: Can sometimes be zero when moving slow.
 
             // If the new segment starts a new planner block, initialize stepper variables and counters.
@@ -492,9 +1033,49 @@ void Stepper_MainISR(void)
 
                 // Initialize Bresenham line and distance counters
                 st.counter_x = st.counter_y = st.counter_z = st.counter_a = st.counter_b = (st.exec_block->step_event_count >> 1);
+
+                backlash_idle = 0;
+
+                if(backlash_enabled)
+                {
+                    // Track direction changes of linear axes. A reversal has to take up the play first.
+                    // If the previous reversal was not fully compensated yet, only the done part is left.
+                    uint8_t reversed = 0;
+
+                    for(uint8_t idx = 0; idx < N_LINEAR_AXIS; idx++)
+                    {
+                        if(st.exec_block->steps[idx] == 0)
+                        {
+                            backlash_idle |= BIT(idx);
+                        }
+                        else if((st.exec_block->direction_bits ^ backlash_dir_bits) & BIT(idx))
+                        {
+                            reversed |= BIT(idx);
+
+                            if(mode != ISR_MODE_HOMING)
+                            {
+                                backlash_remaining[idx] = backlash_steps[idx] - backlash_remaining[idx];
+
+                                if(backlash_remaining[idx] > 0)
+                                {
+                                    backlash_pending |= BIT(idx);
+                                }
+                                else
+                                {
+                                    backlash_pending &= ~BIT(idx);
+                                }
+                            }
+                        }
+                    }
+
+                    backlash_dir_bits ^= reversed;
+                }
             }
 
-            st.dir_outbits = st.exec_block->direction_bits ^ dir_port_invert_mask;
+            // Axes not moved by the block keep their last direction, so leftover play can still be injected
+            uint8_t direction_bits = (st.exec_block->direction_bits & ~backlash_idle) | (backlash_dir_bits & backlash_idle);
+
+            st.dir_outbits = direction_bits ^ dir_port_invert_mask;
 
             // Set the direction pins directly here to make sure that the signal is valid when stepping the steppers
             // Some driver e.g. require a setup time of a few us.
@@ -506,7 +1087,7 @@ void Stepper_MainISR(void)
             {
                 GPIO_ResetBits(GPIO_DIR_X_PORT, GPIO_DIR_X_PIN);
             }
-            if (BIT_IS_FALSE(settings.flags_ext, BITFLAG_LATHE_MODE))
+            if(!lathe)
             {
                 if (st.dir_outbits & (1 << Y_DIRECTION_BIT))
                 {
@@ -525,7 +1106,9 @@ void Stepper_MainISR(void)
             {
                 GPIO_ResetBits(GPIO_DIR_Z_PORT, GPIO_DIR_Z_PIN);
             }
-            if(st.dir_outbits & (1<<A_DIRECTION_BIT))
+#ifdef ENABLE_DUAL_AXIS
+            // Second Y motor
+            if(((direction_bits >> Y_DIRECTION_BIT) ^ (dir_port_invert_mask >> A_DIRECTION_BIT)) & 1)
             {
                 GPIO_SetBits(GPIO_DIR_A_PORT, GPIO_DIR_A_PIN);
             }
@@ -533,36 +1116,30 @@ void Stepper_MainISR(void)
             {
                 GPIO_ResetBits(GPIO_DIR_A_PORT, GPIO_DIR_A_PIN);
             }
-            if(st.dir_outbits & (1<<B_DIRECTION_BIT))
+#elif (N_AXIS > 3)
+            if(st.dir_outbits & (1<<A_DIRECTION_BIT))
             {
-                //GPIO_SetBits(GPIO_DIR_B_PORT, GPIO_DIR_B_PIN);
+                GPIO_SetBits(GPIO_DIR_A_PORT, GPIO_DIR_A_PIN);
             }
             else
             {
-                //GPIO_ResetBits(GPIO_DIR_B_PORT, GPIO_DIR_B_PIN);
+                GPIO_ResetBits(GPIO_DIR_A_PORT, GPIO_DIR_A_PIN);
             }
+#endif
 
             // With AMASS enabled, adjust Bresenham axis increment counters according to AMASS level.
             st.steps[X_AXIS] = st.exec_block->steps[X_AXIS] >> st.exec_segment->amass_level;
             st.steps[Y_AXIS] = st.exec_block->steps[Y_AXIS] >> st.exec_segment->amass_level;
             st.steps[Z_AXIS] = st.exec_block->steps[Z_AXIS] >> st.exec_segment->amass_level;
+#if (N_AXIS > 3)
             st.steps[A_AXIS] = st.exec_block->steps[A_AXIS] >> st.exec_segment->amass_level;
+#endif
+#if (N_AXIS > 4)
             st.steps[B_AXIS] = st.exec_block->steps[B_AXIS] >> st.exec_segment->amass_level;
+#endif
 
-            if(gc_state.modal.spindle_mode == SPINDLE_RPM_MODE)
-            {
-                // Set real-time spindle output as segment is loaded, just prior to the first step.
-                Spindle_SetSpeed(st.exec_segment->spindle_pwm);
-            }
-            else if(st.exec_segment->spindle_pwm != SPINDLE_PWM_OFF_VALUE)
-            {
-                if(--update_g96 == 0)
-                {
-                    sys.x_pos = (sys_position[X_AXIS] / settings.steps_per_mm[X_AXIS]) - (gc_state.coord_system[X_AXIS] + gc_state.coord_offset[X_AXIS] + gc_state.tool_length_offset_dynamic[X_AXIS] + gc_state.tool_length_offset[X_AXIS]);
-                    Spindle_SetSurfaceSpeed(sys.x_pos);
-                    update_g96 = G96_UPDATE_CNT;
-                }
-            }
+            // Set real-time spindle output as segment is loaded, just prior to the first step.
+            Spindle_SetSpeed(st.exec_segment->spindle_pwm);
 
         }
         else
@@ -581,11 +1158,36 @@ void Stepper_MainISR(void)
         }
     }
 
-    // Check probing state.
-    if(sys_probe_state == PROBE_ACTIVE)
+#ifdef ENABLE_ELECTRONIC_GEARBOX
+    if(egb_state != EGB_OFF)
     {
-        Probe_StateMonitor();
+        uint32_t z_steps = labs(sys_position[Z_AXIS] - egb_z_start);
+
+        if(egb_state == EGB_WAIT)
+        {
+            // Engage, once Z-axis reached synchronous speed
+            if(z_steps >= egb_accel_steps)
+            {
+                egb_z_start = sys_position[Z_AXIS];
+                egb_enc_start = Encoder_GetValue();
+                egb_state = EGB_ENGAGED;
+            }
+        }
+        else
+        {
+            // Spindle direction doesn't matter, Z-axis direction is given by the block
+            int32_t counts = (int32_t)(Encoder_GetValue() - egb_enc_start);
+            uint32_t z_target = (uint32_t)(((uint64_t)labs(counts) * egb_ratio) >> 16);
+
+            if(z_steps >= z_target)
+            {
+                // Z-axis is ahead of spindle. Hold this tick.
+                st.step_outbits = 0;
+                return;
+            }
+        }
     }
+#endif
 
     // Reset step out bits.
     st.step_outbits = 0;
@@ -606,20 +1208,6 @@ void Stepper_MainISR(void)
         {
             sys_position[X_AXIS]++;
         }
-
-        if (fabsf(current_backlash[X_AXIS]) > 0.5)
-        {
-            if (current_backlash[X_AXIS] > 0.0)
-            {
-                current_backlash[X_AXIS] -= 1.0;
-                sys_position[X_AXIS]--;
-            }
-            else
-            {
-                current_backlash[X_AXIS] += 1.0;
-                sys_position[X_AXIS]++;
-            }
-        }
     }
 
     st.counter_y += st.steps[Y_AXIS];
@@ -637,20 +1225,6 @@ void Stepper_MainISR(void)
         {
             sys_position[Y_AXIS]++;
         }
-
-        if (fabsf(current_backlash[Y_AXIS]) > 0.5)
-        {
-            if (current_backlash[Y_AXIS] > 0.0)
-            {
-                current_backlash[Y_AXIS] -= 1.0;
-                sys_position[Y_AXIS]--;
-            }
-            else
-            {
-                current_backlash[Y_AXIS] += 1.0;
-                sys_position[Y_AXIS]++;
-            }
-        }
     }
 
     st.counter_z += st.steps[Z_AXIS];
@@ -668,42 +1242,31 @@ void Stepper_MainISR(void)
         {
             sys_position[Z_AXIS]++;
         }
-
-        if (fabsf(current_backlash[Z_AXIS]) > 0.5)
-        {
-            if (current_backlash[Z_AXIS] > 0.0)
-            {
-                current_backlash[Z_AXIS] -= 1.0;
-                sys_position[Z_AXIS]--;
-            }
-            else
-            {
-                current_backlash[Z_AXIS] += 1.0;
-                sys_position[Z_AXIS]++;
-            }
-        }
     }
 
+#if (N_AXIS > 3)
     st.counter_a += st.steps[A_AXIS];
 
     if(st.counter_a > st.exec_block->step_event_count)
     {
+#ifndef ENABLE_DUAL_AXIS
+        // NOTE: With dual axis, A is tracked only. Its output drives the second Y motor.
         st.step_outbits |= (1<<A_STEP_BIT);
+#endif
         st.counter_a -= st.exec_block->step_event_count;
 
-        //if(st.exec_segment->backlash_motion == 0)
+        if(st.exec_block->direction_bits & (1<<A_DIRECTION_BIT))
         {
-            if(st.exec_block->direction_bits & (1<<A_DIRECTION_BIT))
-            {
-                sys_position[A_AXIS]--;
-            }
-            else
-            {
-                sys_position[A_AXIS]++;
-            }
+            sys_position[A_AXIS]--;
+        }
+        else
+        {
+            sys_position[A_AXIS]++;
         }
     }
+#endif
 
+#if (N_AXIS > 4)
     st.counter_b += st.steps[B_AXIS];
 
     if(st.counter_b > st.exec_block->step_event_count)
@@ -711,21 +1274,60 @@ void Stepper_MainISR(void)
         st.step_outbits |= (1<<B_STEP_BIT);
         st.counter_b -= st.exec_block->step_event_count;
 
-        //if(st.exec_segment->backlash_motion == 0)
+        if(st.exec_block->direction_bits & (1<<B_DIRECTION_BIT))
         {
-            if(st.exec_block->direction_bits & (1<<B_DIRECTION_BIT))
-            {
-                sys_position[B_AXIS]--;
-            }
-            else
+            sys_position[B_AXIS]--;
+        }
+        else
+        {
+            sys_position[B_AXIS]++;
+        }
+    }
+#endif
+
+    if(mode == ISR_MODE_PROBING)
+    {
+        // Counted, but output on next tick
+        st.pending_outbits = st.step_outbits;
+        st.pending_dirbits = st.exec_block->direction_bits;
+    }
+
+    // Inject pending backlash steps at a fixed rate. An axis, which steps anyway in this tick, is
+    // skipped. The direction pins already point into the reversed direction, also for axes not
+    // moved by the block.
+    if(mode != ISR_MODE_HOMING && backlash_pending)
+    {
+        backlash_cycles += st.cycles_per_tick;
+
+        if(backlash_cycles >= (F_TIMER_STEPPER / BACKLASH_STEP_RATE_HZ))
+        {
+            backlash_cycles = 0;
+
+            for(uint8_t idx = 0; idx < N_LINEAR_AXIS; idx++)
             {
-                sys_position[B_AXIS]++;
+                if((backlash_pending & BIT(idx)) && !(st.step_outbits & BIT(idx)))
+                {
+                    st.step_outbits |= BIT(idx);
+
+                    if(--backlash_remaining[idx] == 0)
+                    {
+                        backlash_pending &= ~BIT(idx);
+                    }
+                }
             }
         }
     }
 
+#ifdef ENABLE_DUAL_AXIS
+    // Second Y motor follows all Y steps, including backlash. Homing locks both motors separately.
+    if(!lathe && (st.step_outbits & (1<<Y_STEP_BIT)))
+    {
+        st.step_outbits |= (1<<A_STEP_BIT);
+    }
+#endif
+
     // During a homing cycle, lock out and prevent desired axes from moving.
-    if(sys.state == STATE_HOMING)
+    if(mode == ISR_MODE_HOMING)
     {
         st.step_outbits &= sys.homing_axis_lock;
     }
@@ -740,6 +1342,77 @@ void Stepper_MainISR(void)
         {
             segment_buffer_tail = 0;
         }
+
+#ifdef STEPPER_PREP_IN_ISR
+        // Request a refill, when the segment buffer is running low
+        uint8_t segments = (segment_buffer_head >= segment_buffer_tail) ? (segment_buffer_head - segment_buffer_tail) :
+                           (SEGMENT_BUFFER_SIZE - (segment_buffer_tail - segment_buffer_head));
+
+        if(segments < SEGMENT_BUFFER_REFILL_THRESHOLD)
+        {
+            SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+        }
+#endif
+    }
+}
+
+
+// Specialised stepper ISR variants.
+static void Stepper_ISR_Mill(void)          { Stepper_ISRBody(false, ISR_MODE_NORMAL); }
+static void Stepper_ISR_MillProbing(void)   { Stepper_ISRBody(false, ISR_MODE_PROBING); }
+static void Stepper_ISR_MillHoming(void)    { Stepper_ISRBody(false, ISR_MODE_HOMING); }
+static void Stepper_ISR_Lathe(void)         { Stepper_ISRBody(true, ISR_MODE_NORMAL); }
+static void Stepper_ISR_LatheProbing(void)  { Stepper_ISRBody(true, ISR_MODE_PROBING); }
+static void Stepper_ISR_LatheHoming(void)   { Stepper_ISRBody(true, ISR_MODE_HOMING); }
+
+
+// Selects the stepper ISR variant for the machine type and the motion about to start.
+// Called before the stepper interrupt is enabled, and whenever the homing or probing state changes.
+void Stepper_SelectISR(void)
+{
+    bool lathe = BIT_IS_TRUE(settings.flags_ext, BITFLAG_LATHE_MODE);
+
+    if(sys.state == STATE_HOMING)
+    {
+        stepper_isr = lathe ? Stepper_ISR_LatheHoming : Stepper_ISR_MillHoming;
+    }
+    else if(sys_probe_state == PROBE_ACTIVE || Scan_IsActive())
+    {
+        stepper_isr = lathe ? Stepper_ISR_LatheProbing : Stepper_ISR_MillProbing;
+    }
+    else
+    {
+        stepper_isr = lathe ? Stepper_ISR_Lathe : Stepper_ISR_Mill;
+    }
+}
+
+
+void Stepper_MainISR(void)
+{
+    stepper_isr();
+}
+
+
+// Machine position of the steps output so far. Steps are counted into sys_position one ISR tick
+// before their pulse is output, these are taken back. Only valid while probing.
+// NOTE: Must not be interrupted by the stepper ISR.
+void Stepper_GetOutputPosition(int32_t *position)
+{
+    memcpy(position, sys_position, sizeof(sys_position));
+
+    for(uint8_t idx = 0; idx < N_AXIS; idx++)
+    {
+        if(st.pending_outbits & BIT(idx))
+        {
+            if(st.pending_dirbits & BIT(idx))
+            {
+                position[idx]++;
+            }
+            else
+            {
+                position[idx]--;
+            }
+        }
     }
 }
 
@@ -836,6 +1509,8 @@ void Stepper_GenerateStepDirInvertMasks(void)
 // Reset and clear stepper subsystem variables
 void Stepper_Reset(void)
 {
+    Stepper_PrepLock();
+
     // Initialize stepper driver idle state.
     Stepper_Disable(0);
 
@@ -849,6 +1524,13 @@ void Stepper_Reset(void)
     segment_buffer_head = 0; // empty = tail
     segment_next_head = 1;
 
+#ifdef ENABLE_ELECTRONIC_GEARBOX
+    egb_state = EGB_OFF;
+#endif
+#ifdef ENABLE_PARALLEL_HOMING
+    homing_gen = 0;
+#endif
+
     Stepper_GenerateStepDirInvertMasks();
     st.dir_outbits = dir_port_invert_mask; // Initialize direction bits to default.
 
@@ -866,6 +1548,8 @@ void Stepper_Reset(void)
     GPIO_ResetBits(GPIO_DIR_Z_PORT, GPIO_DIR_Z_PIN);
     GPIO_ResetBits(GPIO_DIR_A_PORT, GPIO_DIR_A_PIN);
     //GPIO_ResetBits(GPIO_DIR_B_PORT, GPIO_DIR_B_PIN);
+
+    Stepper_PrepUnlock();
 }
 
 
@@ -952,6 +1636,57 @@ void Stepper_ParkingRestoreBuffer()
    NOTE: Computation units are in steps, millimeters, and minutes.
 */
 void Stepper_PrepareBuffer(void)
+{
+    Stepper_PrepLock();
+    Stepper_PrepareSegments();
+    Stepper_PrepUnlock();
+}
+
+
+// Refills the segment buffer from the low priority PendSV interrupt. Requested by the stepper ISR,
+// when the segment buffer runs low, so step generation doesn't depend on main loop latency.
+void Stepper_PrepareBufferISR(void)
+{
+    if(prep_lock)
+    {
+        // Main program is modifying planner or prep data. Retry on unlock.
+        prep_pending = 1;
+        return;
+    }
+
+    if(sys.state & (STATE_CYCLE | STATE_HOLD | STATE_SAFETY_DOOR | STATE_HOMING | STATE_SLEEP | STATE_JOG))
+    {
+        Stepper_PrepareSegments();
+    }
+}
+
+
+// Blocks the refill interrupt from touching planner and segment prep data. Must be held by the main
+// program, while modifying the planner buffer, sys.step_control or the prep state. Nestable.
+void Stepper_PrepLock(void)
+{
+    prep_lock++;
+}
+
+
+void Stepper_PrepUnlock(void)
+{
+    if(prep_lock > 0)
+    {
+        prep_lock--;
+    }
+
+    if(prep_lock == 0 && prep_pending)
+    {
+        prep_pending = 0;
+#ifdef STEPPER_PREP_IN_ISR
+        SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+#endif
+    }
+}
+
+
+static void Stepper_PrepareSegments(void)
 {
     // Block step prep buffer, while in a suspend state and there is no suspend motion to execute.
     if(BIT_IS_TRUE(sys.step_control,STEP_CONTROL_END_MOTION))
@@ -1180,7 +1915,6 @@ void Stepper_PrepareBuffer(void)
         // Set new segment to point to the current segment data block.
         prep_segment->st_block_index = prep.st_block_index;
 
-        prep_segment->backlash_motion = pl_block->backlash_motion;
 
         /*------------------------------------------------------------------------------------
         Compute the average velocity of this new segment by determining the total distance
@@ -1326,12 +2060,19 @@ void Stepper_PrepareBuffer(void)
         Compute spindle speed PWM output for step segment
         */
 
-        if(st_prep_block->is_pwm_rate_adjusted || (sys.step_control & STEP_CONTROL_UPDATE_SPINDLE_PWM))
+        if(st_prep_block->is_pwm_rate_adjusted || pl_block->spindle_css || (sys.step_control & STEP_CONTROL_UPDATE_SPINDLE_PWM))
         {
             if(pl_block->condition & (PL_COND_FLAG_SPINDLE_CW | PL_COND_FLAG_SPINDLE_CCW))
             {
                 float rpm = pl_block->spindle_speed;
 
+                if(pl_block->spindle_css)
+                {
+                    // Constant surface speed at X position of segment end
+                    float x_pos = pl_block->css_x_end - pl_block->css_x_dir*mm_remaining;
+                    rpm = Spindle_SurfaceSpeedToRpm(rpm, x_pos, pl_block->spindle_limit);
+                }
+
                 // NOTE: Feed and rapid overrides are independent of PWM value and do not alter laser power/rate.
                 if(st_prep_block->is_pwm_rate_adjusted)
                 {
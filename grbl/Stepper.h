@@ -23,9 +23,6 @@
 #define STEPPER_H
 
 
-extern float current_backlash[];
-
-
 // Initialize and setup the stepper motor subsystem
 void Stepper_Init(void);
 
@@ -35,9 +32,18 @@ void Stepper_WakeUp(void);
 // Immediately disables steppers
 void Stepper_Disable(uint8_t ovr_disable);
 
+// Returns true, if the stepper drivers are energised
+bool Stepper_DriversEnabled(void);
+
 // Main ISR
 void Stepper_MainISR(void);
 
+// Selects the specialised main ISR for the current machine type and motion mode
+void Stepper_SelectISR(void);
+
+// Machine position of the steps output so far. Called by the probe interrupt.
+void Stepper_GetOutputPosition(int32_t *position);
+
 // Stepper Port Reset ISR
 void Stepper_PortResetISR(void);
 
@@ -47,6 +53,9 @@ void Stepper_GenerateStepDirInvertMasks(void);
 // Reset the stepper subsystem variables
 void Stepper_Reset(void);
 
+// Clears pending backlash steps. Keeps the tracked direction of each axis.
+void Stepper_ResetBacklash(void);
+
 // Changes the run state of the step segment buffer to execute the special parking motion.
 void Stepper_ParkingSetupBuffer(void);
 
@@ -56,6 +65,13 @@ void Stepper_ParkingRestoreBuffer(void);
 // Reloads step segment buffer. Called continuously by realtime execution system.
 void Stepper_PrepareBuffer(void);
 
+// Reloads step segment buffer from the PendSV interrupt.
+void Stepper_PrepareBufferISR(void);
+
+// Guard planner and segment prep data against the refill interrupt.
+void Stepper_PrepLock(void);
+void Stepper_PrepUnlock(void);
+
 // Called by planner_recalculate() when the executing block is updated by the new plan.
 void Stepper_UpdatePlannerBlockParams(void);
 
@@ -64,5 +80,37 @@ float Stepper_GetRealtimeRate(void);
 
 void Stepper_Ovr(float ovr);
 
+// Couple Z-axis to spindle encoder with given pitch (mm/rev), after Z moved accel_dist (mm).
+void Stepper_GearboxSetup(float pitch, float accel_dist);
+
+// Decouple Z-axis from spindle encoder
+void Stepper_GearboxStop(void);
+
+// Rigid tapping: Slaves the Z-axis position to the spindle encoder with given pitch (mm/rev). depth is the
+// signed Z distance to the bottom of the hole. The cycle is aborted, if Z passes it by more than overshoot (mm).
+void Stepper_TapStart(float pitch, float depth, float overshoot);
+// Called after reversing the spindle. The tap ends, when Z is back at the start.
+void Stepper_TapRetract(void);
+bool Stepper_TapDepthReached(void);
+bool Stepper_TapActive(void);
+// True, if the tap was stopped at the overshoot limit
+bool Stepper_TapFailed(void);
+
+// Parallel homing. Each channel is a step output (X, Y, Z, A) with its own trapezoidal velocity profile,
+// independent of the segment buffer. With ENABLE_DUAL_AXIS the A channel drives the second Y motor.
+#define STEPPER_HOMING_CHANNELS     4
+
+// Takes over the homing ISR. step_rate (steps/s) is the fastest rate used by any channel.
+void Stepper_HomingInit(float step_rate);
+// Moves a channel by the signed number of steps with rate (steps/s) and accel (steps/s^2). Channel must be idle.
+void Stepper_HomingMove(uint8_t channel, int32_t steps, float rate, float accel);
+// Switch engaged. The channel records its position and decelerates to a stop. Called by the limit interrupts.
+void Stepper_HomingStop(uint8_t channel);
+bool Stepper_HomingBusy(uint8_t channel);
+// Steps moved by the channel since Stepper_HomingInit()
+int32_t Stepper_HomingPosition(uint8_t channel);
+// True, if the last move was stopped by its switch. The channel position at the stop request is stored in trigger.
+bool Stepper_HomingTriggered(uint8_t channel, int32_t *trigger);
+
 
 #endif // STEPPER_H
@@ -26,12 +26,18 @@
 #include "GPIO.h"
 #include "MotionControl.h"
 #include "Protocol.h"
+#include "Scheduler.h"
 #include "Report.h"
 #include "Settings.h"
 #include "Stepper.h"
 #include "System.h"
 #include "ToolChange.h"
 #include "System32.h"
+#include "EXTI.h"
+#include "TIM.h"
+#include "ProbeScan.h"
+#include "HeightMap.h"
+#include "Recovery.h"
 
 
 // Declare system global variable structure
@@ -60,6 +66,19 @@ void System_Init(void)
     GPIO_InitGPIO(GPIO_SYSTEM);
     last_state = 0;
 
+    // Input debounce timer
+    TIM2_Init();
+
+    // Each control pin has its own EXTI line
+    Exti_ConfigLine(EXTI_PortSourceGPIOA, EXTI_PinSource0); // Reset
+    Exti_ConfigLine(EXTI_PortSourceGPIOA, EXTI_PinSource1); // Feed hold
+    Exti_ConfigLine(EXTI_PortSourceGPIOC, EXTI_PinSource2); // Safety door
+    Exti_ConfigLine(EXTI_PortSourceGPIOA, EXTI_PinSource4); // Cycle start
+    Exti_Init0(2, 0);
+    Exti_Init1(2, 0);
+    Exti_Init2(2, 0);
+    Exti_Init4(2, 0);
+
     sys.system_flags |= BITFLAG_ENABLE_SYSTEM_INPUT;
     System_GetControlState(false);
 }
@@ -92,10 +111,10 @@ void System_ResetPosition(void)
 uint8_t System_GetControlState(bool held)
 {
     uint8_t control_state = 0;
-    uint8_t pin = ((GPIO_ReadInputDataBit(GPIOA, GPIO_Pin_0)<<CONTROL_RESET_BIT) |
-                   (GPIO_ReadInputDataBit(GPIOA, GPIO_Pin_1)<<CONTROL_FEED_HOLD_BIT) |
-                   (GPIO_ReadInputDataBit(GPIOA, GPIO_Pin_4)<<CONTROL_CYCLE_START_BIT) |
-                   (GPIO_ReadInputDataBit(GPIOB, GPIO_Pin_8)<<CONTROL_SAFETY_DOOR_BIT));
+    uint8_t pin = ((GPIO_ReadInputDataBit(GPIO_CTRL_RST_PORT, GPIO_CTRL_RST_PIN)<<CONTROL_RESET_BIT) |
+                   (GPIO_ReadInputDataBit(GPIO_CTRL_FEED_PORT, GPIO_CTRL_FEED_PIN)<<CONTROL_FEED_HOLD_BIT) |
+                   (GPIO_ReadInputDataBit(GPIO_CTRL_START_PORT, GPIO_CTRL_START_PIN)<<CONTROL_CYCLE_START_BIT) |
+                   (GPIO_ReadInputDataBit(GPIO_DOOR_PORT, GPIO_DOOR_PIN)<<CONTROL_SAFETY_DOOR_BIT));
 
     // Invert control pins if necessary
     pin ^= CONTROL_MASK & settings.input_invert_mask;
@@ -167,6 +186,18 @@ void System_PinChangeISR(void)
 }
 
 
+// Edge on a control pin EXTI line or end of its debounce time. Acts on newly triggered pins only.
+void System_ControlEdgeISR(void)
+{
+    uint8_t controls = System_GetControlState(false);
+
+    if (controls && (sys.system_flags & BITFLAG_ENABLE_SYSTEM_INPUT))
+    {
+        System_PinChangeISR();
+    }
+}
+
+
 // Returns if safety door is ajar(T) or closed(F), based on pin state.
 uint8_t System_CheckSafetyDoorAjar(void)
 {
@@ -234,6 +265,7 @@ uint8_t System_ExecuteLine(char *line)
     case '$':
     case 'G':
     case 'C':
+    case 'Q':
     case 'X':
         if(line[2] != 0)
         {
@@ -259,6 +291,11 @@ uint8_t System_ExecuteLine(char *line)
             Report_GCodeModes();
             break;
 
+        case 'Q': // Prints and clears main loop task statistics
+            Report_SchedulerStats();
+            Scheduler_ResetStats();
+            break;
+
         case 'C': // Set check g-code mode [IDLE/CHECK]
             // Perform reset when toggling off. Check g-code mode should only work if Grbl
             // is idle and ready, regardless of alarm locks. This is mainly to keep things
@@ -506,7 +543,35 @@ uint8_t System_ExecuteLine(char *line)
             }
             break;
 
-        case 'S': // Puts Grbl to sleep [IDLE/ALARM]
+        case 'S': // Puts Grbl to sleep or controls scanning probe mode [IDLE/ALARM]
+            if((line[2] == 'C') && (line[3] == 'A') && (line[4] == 'N'))
+            {
+                // $SCAN=<distance> starts, $SCAN stops scanning
+                if(line[5] == 0)
+                {
+                    Scan_Stop();
+                    Report_FeedbackMessage(MESSAGE_DISABLED);
+                    break;
+                }
+
+                char_counter = 6;
+                if(line[5] != '=' || !Read_Float(line, &char_counter, &value))
+                {
+                    return STATUS_BAD_NUMBER_FORMAT;
+                }
+                if(line[char_counter] != 0)
+                {
+                    return STATUS_INVALID_STATEMENT;
+                }
+                if(value < 0.0)
+                {
+                    return STATUS_NEGATIVE_VALUE;
+                }
+
+                Scan_Start(value);
+                Report_FeedbackMessage(MESSAGE_ENABLED);
+                break;
+            }
             if((line[2] != 'L') || (line[3] != 'P') || (line[4] != 0))
             {
                 return (STATUS_INVALID_STATEMENT);
@@ -514,6 +579,83 @@ uint8_t System_ExecuteLine(char *line)
             System_SetExecStateFlag(EXEC_SLEEP); // Set to execute sleep mode immediately
             break;
 
+        case 'M': // Print height map, probe grid or enable/disable compensation [IDLE/ALARM]
+            if(line[2] == 0)
+            {
+                Report_HeightMap();
+                break;
+            }
+            if((line[2] == 'P') && (line[3] == '='))
+            {
+                // $MP=<size x>,<size y>,<points x>,<points y>,<depth>,<feed> [IDLE]
+                float grid[6];
+
+                if(sys.state != STATE_IDLE)
+                {
+                    return STATUS_IDLE_ERROR;
+                }
+
+                char_counter = 4;
+                for(helper_var = 0; helper_var < 6; helper_var++)
+                {
+                    if(!Read_Float(line, &char_counter, &grid[helper_var]))
+                    {
+                        return STATUS_BAD_NUMBER_FORMAT;
+                    }
+                    if(line[char_counter] != ((helper_var < 5) ? ',' : 0))
+                    {
+                        return STATUS_INVALID_STATEMENT;
+                    }
+                    char_counter++;
+                }
+                if(grid[2] < 0.0 || grid[3] < 0.0)
+                {
+                    return STATUS_NEGATIVE_VALUE;
+                }
+                if(grid[2] > 255.0 || grid[3] > 255.0)
+                {
+                    return STATUS_GCODE_MAX_VALUE_EXCEEDED;
+                }
+
+                switch(HeightMap_ProbeGrid(grid[0], grid[1], (uint8_t)grid[2], (uint8_t)grid[3], grid[4], grid[5]))
+                {
+                case 0:
+                    break;
+
+                case 1:
+                    return STATUS_INVALID_STATEMENT;
+
+                default:
+                    return STATUS_PROBE_ERROR;
+                }
+                break;
+            }
+            if((line[2] != '=') || (line[4] != 0))
+            {
+                return STATUS_INVALID_STATEMENT;
+            }
+            if(line[3] == '1')
+            {
+                if(!HeightMap_Enable(true))
+                {
+                    // No valid map
+                    return STATUS_SETTING_DISABLED;
+                }
+                Report_FeedbackMessage(MESSAGE_ENABLED);
+            }
+            else if(line[3] == '0')
+            {
+                HeightMap_Enable(false);
+                Report_FeedbackMessage(MESSAGE_DISABLED);
+            }
+            else
+            {
+                return STATUS_INVALID_STATEMENT;
+            }
+            // Parser position is uncompensated
+            GC_SyncPosition();
+            break;
+
         case 'I': // Print or store build info. [IDLE/ALARM]
             if(line[++char_counter] == 0)
             {
@@ -541,7 +683,52 @@ uint8_t System_ExecuteLine(char *line)
             }
             break;
 
-        case 'R': // Restore defaults [IDLE/ALARM]
+        case 'R': // Restore defaults, last position or job [IDLE/ALARM]
+#ifdef ENABLE_RECOVERY
+            if((line[2] == 'P') && (line[3] == 0))
+            {
+                if(System_CheckSafetyDoorAjar())
+                {
+                    return (STATUS_CHECK_DOOR);
+                }
+
+                uint8_t status = Recovery_RestorePosition();
+
+                if(status != STATUS_OK)
+                {
+                    return status;
+                }
+
+                if(sys.state == STATE_ALARM)
+                {
+                    Report_FeedbackMessage(MESSAGE_ALARM_UNLOCK);
+                    sys.state = STATE_IDLE;
+                }
+                Stepper_WakeUp();
+                break;
+            }
+            if(line[2] == 'J')
+            {
+                // $RJ prints the job checkpoint, $RJ=<line> resumes the job at that line
+                if(line[3] == 0)
+                {
+                    if(Recovery_GetCheckpoint() == 0)
+                    {
+                        return STATUS_RECOVERY_INVALID;
+                    }
+                    Report_RecoveryCheckpoint();
+                    break;
+                }
+
+                char_counter = 4;
+                if(line[3] != '=' || !Read_Float(line, &char_counter, &value) || line[char_counter] != 0)
+                {
+                    return STATUS_BAD_NUMBER_FORMAT;
+                }
+
+                return Recovery_StartJob((int32_t)value);
+            }
+#endif
             if((line[2] != 'S') || (line[3] != 'T') || (line[4] != '=') || (line[6] != 0))
             {
                 return (STATUS_INVALID_STATEMENT);
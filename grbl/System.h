@@ -53,6 +53,8 @@
 #define EXEC_ALARM_HOMING_FAIL_DOOR         7
 #define EXEC_ALARM_HOMING_FAIL_PULLOFF      8
 #define EXEC_ALARM_HOMING_FAIL_APPROACH     9
+#define EXEC_ALARM_SPINDLE_AT_SPEED         10
+#define EXEC_ALARM_RIGID_TAP                11
 
 #define EXEC_ALARM_HARD_LIMIT_X1            21
 #define EXEC_ALARM_HARD_LIMIT_X2            22
@@ -156,7 +158,6 @@ typedef struct
     float spindle_speed;
     uint8_t is_homed;
     uint8_t sync_move;
-    float x_pos;                // Current x-position of tool (for G96)
 
     uint8_t system_flags;       // Runtime flags
 } System_t;
@@ -184,6 +185,9 @@ void System_ResetPosition(void);
 // Returns bitfield of control pin states, organized by CONTROL_PIN_INDEX. (1=triggered, 0=not triggered).
 uint8_t System_GetControlState(bool held);
 
+// Control pin interrupt handler. Called on EXTI edge and after debouncing.
+void System_ControlEdgeISR(void);
+
 // Returns if safety door is open or closed, based on pin state.
 uint8_t System_CheckSafetyDoorAjar(void);
 
@@ -82,7 +82,6 @@ void TC_ChangeCurrentTool(void)
 
     pl_data.feed_rate = 0.0;
     pl_data.condition |= PL_COND_FLAG_RAPID_MOTION; // Set rapid motion condition flag.
-    pl_data.backlash_motion = 0;
     pl_data.spindle_speed = 0;
     pl_data.line_number = gc_state.line_number;
 
@@ -137,7 +136,6 @@ uint8_t TC_ProbeTLS(void)
     // Set-up planer
     pl_data.feed_rate = 0.0;
     pl_data.condition |= PL_COND_FLAG_RAPID_MOTION; // Set rapid motion condition flag.
-    pl_data.backlash_motion = 0;
     pl_data.spindle_speed = 0;
     pl_data.line_number = gc_state.line_number;
 
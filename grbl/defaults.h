@@ -79,6 +79,8 @@
     #define DEFAULT_HOMING_SEEK_RATE          500.0   // mm/min
     #define DEFAULT_HOMING_DEBOUNCE_DELAY     250     // msec (0-65k)
     #define DEFAULT_HOMING_PULLOFF            1.0     // mm
+    #define DEFAULT_GANTRY_OFFSET_1           0.0     // mm
+    #define DEFAULT_GANTRY_OFFSET_2           0.0     // mm
     #define DEFAULT_TOOL_CHANGE_MODE          0       // 0 = Ignore M6; 1 = Manual tool change; 2 = Manual tool change + TLS
     #define DEFAULT_ENCODER_PULSES_PER_REV          360     // PPR for lathe encoder
     #define USE_MULTI_AXIS                          0       // false
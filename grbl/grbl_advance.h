@@ -6,13 +6,17 @@
 #include "CoolantControl.h"
 #include "debug.h"
 #include "GCode.h"
+#include "HeightMap.h"
+#include "Recovery.h"
 #include "Jog.h"
 #include "Limits.h"
 #include "MotionControl.h"
 #include "Planner.h"
 #include "Probe.h"
+#include "ProbeScan.h"
 #include "Protocol.h"
 #include "Report.h"
+#include "Scheduler.h"
 #include "Settings.h"
 #include "SpindleControl.h"
 #include "Stepper.h"
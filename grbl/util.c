@@ -22,6 +22,7 @@
 #include <string.h>
 #include "Config.h"
 #include "Protocol.h"
+#include "Scheduler.h"
 #include "Print.h"
 #include "System.h"
 #include "Settings.h"
@@ -233,8 +234,8 @@ void Delay_sec(float seconds, uint8_t mode)
         }
         else   // DELAY_MODE_SYS_SUSPEND
         {
-            // Execute rt_system() only to avoid nesting suspend loops.
-            Protocol_ExecRtSystem();
+            // Execute scheduled tasks only to avoid nesting suspend loops.
+            Scheduler_Run();
 
             if(sys.suspend & SUSPEND_RESTART_RETRACT)
             {
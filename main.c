@@ -41,6 +41,7 @@ int main(void)
     GrIP_Init();
 
     Settings_Init();
+    HeightMap_Init();
     System_Init();
 
     Stepper_Init();
@@ -48,6 +49,10 @@ int main(void)
 
     System_ResetPosition();
 
+#ifdef ENABLE_RECOVERY
+    Recovery_Init();
+#endif
+
 #if (USE_ETH_IF)
     // Initialize TCP server
     ServerTCP_Init(ETH_SOCK, ETH_PORT);
@@ -69,6 +74,9 @@ int main(void)
     // Init SysTick 1ms
     SysTick_Init();
 
+    // Register realtime tasks
+    Protocol_Init();
+
     // Grbl-Advanced initialization loop upon power-up or a system abort. For the latter, all processes
     // will return to this loop to be cleanly re-initialized.
     while(1)
@@ -101,6 +109,7 @@ int main(void)
         Coolant_Init();
         Limits_Init();
         Probe_Init();
+        Scan_Init();
         Spindle_Init();
         Stepper_Reset();
 